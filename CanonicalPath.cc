@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include "CanonicalPath.hh"
+
+/**
+ * Normalise a path into a buffer
+ * Output is never longer than input, so the buffer may be the path itself
+ * @param path Path to normalise
+ * @param length Length of the path
+ * @param buffer Output, at least length + 1 bytes, NUL-terminated
+ * @return Length of the normalised path
+ */
+std::size_t canonicalize_path(const char * path, std::size_t length, char * buffer)
+{
+	bool absolute = length != 0 && path[0] == '/';
+	std::size_t w = 0, r = 0;
+	if(absolute)
+		buffer[w++] = '/';
+	// Nothing before floor can be removed by ".."
+	std::size_t floor = w;
+	while(r < length)
+	{
+		while(r < length && path[r] == '/')
+			++r;
+		std::size_t start = r;
+		while(r < length && path[r] != '/')
+			++r;
+		std::size_t componentLength = r - start;
+		if(componentLength == 0 || (componentLength == 1 && path[start] == '.'))
+			continue;
+		// Checked before the component is moved, which may overwrite it when normalising in place
+		bool parent = componentLength == 2 && path[start] == '.' && path[start + 1] == '.';
+		if(parent)
+		{
+			if(w > floor)
+			{
+				while(w > floor && buffer[w - 1] != '/')
+					--w;
+				if(w > floor)
+					--w;
+				continue;
+			}
+			if(absolute)
+				continue;
+		}
+		if(w != 0 && buffer[w - 1] != '/')
+			buffer[w++] = '/';
+		std::memmove(buffer + w, path + start, componentLength);
+		w += componentLength;
+		if(parent)
+			floor = w;
+	}
+	if(w == 0 && length != 0)
+		buffer[w++] = '.';
+	buffer[w] = '\0';
+	return w;
+}
+
+/**
+ * Normalise a NUL-terminated path in place
+ * @return Length of the normalised path
+ */
+std::size_t canonicalize_path(char * path, std::size_t length)
+{
+	return canonicalize_path(path, length, path);
+}
+
+void canonicalize_path_in_place(std::string & path)
+{
+	if(path.empty())
+		return;
+	path.resize(canonicalize_path(&path[0], path.size()));
+}
+
+std::string canonicalize_path(std::string path)
+{
+	canonicalize_path_in_place(path);
+	return path;
+}
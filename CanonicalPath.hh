@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CANONICAL_PATH_HH__
+#define __CANONICAL_PATH_HH__
+
+#include <string>
+
+/**
+ * Lexical path normalisation, the single routine used to build every path compared as a string
+ * Repeated slashes, "." and ".." components are resolved in one pass without touching the
+ * filesystem, a trailing slash is dropped. ".." never climbs above "/" and is kept at
+ * the start of a relative path.
+ */
+std::size_t canonicalize_path(const char *, std::size_t, char *);
+std::size_t canonicalize_path(char *, std::size_t);
+void canonicalize_path_in_place(std::string &);
+std::string canonicalize_path(std::string);
+
+#endif // __CANONICAL_PATH_HH__
@@ -0,0 +1,819 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include <paludis/paludis.hh>
+#include <paludis/util/fs_error.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CanonicalPath.hh"
+#include "CollisionCheck.hh"
+#include "CollisionStats.hh"
+#include "OwnerClient.hh"
+#include "OwnerFinder.hh"
+#include "OwnerIndex.hh"
+#include "WorkStealingPool.hh"
+
+/**
+ * State shared by the workers walking ${IMAGE}
+ */
+struct ImageWalk
+{
+	int imageFd;
+	int rootFd;
+	std::string rootPrefix;
+	const CollisionIgnore * collIgnore;
+	bool allFiles;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::string> pending;
+	unsigned int busy;
+	std::atomic<std::size_t> existing;
+	std::exception_ptr error;
+};
+
+namespace
+{
+	/**
+	 * Check whether an error only means a path is missing
+	 * @param error errno value
+	 * @return whether the path does not exist
+	 */
+	bool missing(int error)
+	{
+		return error == ENOENT || error == ENOTDIR;
+	}
+
+	std::string describe(const std::string & what, const std::string & path, int error)
+	{
+		return "Cannot " + what + " '" + path + "': " + std::strerror(error);
+	}
+}
+
+/**
+ * List one directory of ${IMAGE}
+ * The matching directory of ${ROOT} is opened once and every file is checked relative to it.
+ * When it does not exist nothing below can collide, and the directory is skipped altogether
+ * unless all files are wanted. Any other error is thrown, so that no file is silently left out.
+ * @param walk Walk state
+ * @param directory Directory relative to ${IMAGE}, empty for ${IMAGE} itself
+ * @param subdirs Subdirectories found
+ * @param files Files found, with whether they exist in ${ROOT}
+ */
+void walk_image_directory(ImageWalk & walk, const std::string & directory, std::vector<std::string> & subdirs, FSPathList & files)
+{
+	const char * relative = directory.empty() ? "." : directory.c_str();
+	std::string prefix(walk.rootPrefix + "/" + directory + (directory.empty() ? "" : "/"));
+	int rootDirFd = ::openat(walk.rootFd, relative, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(rootDirFd == -1)
+	{
+		if(!missing(errno))
+			throw paludis::FSError(describe("open", prefix, errno));
+		if(!walk.allFiles)
+			return;
+	}
+	int dirFd = ::openat(walk.imageFd, relative, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	DIR * dir = dirFd == -1 ? nullptr : ::fdopendir(dirFd);
+	if(!dir)
+	{
+		int error = errno;
+		if(dirFd != -1)
+			::close(dirFd);
+		if(rootDirFd != -1)
+			::close(rootDirFd);
+		throw paludis::FSError(describe("open", "${IMAGE}/" + directory, error));
+	}
+	std::string path, failure;
+	unsigned long statCalls = 0;
+	std::size_t existing = 0;
+	while(true)
+	{
+		errno = 0;
+		struct dirent * de = ::readdir(dir);
+		if(!de)
+		{
+			if(errno != 0)
+				failure = describe("read", "${IMAGE}/" + directory, errno);
+			break;
+		}
+		// Dotfiles are skipped, as FSIterator used to do
+		if(de->d_name[0] == '.')
+			continue;
+		bool isDirectory = de->d_type == DT_DIR;
+		if(de->d_type == DT_UNKNOWN)
+		{
+			struct stat st;
+			++statCalls;
+			if(::fstatat(dirFd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+			{
+				failure = describe("stat", "${IMAGE}/" + directory + "/" + de->d_name, errno);
+				break;
+			}
+			isDirectory = S_ISDIR(st.st_mode);
+		}
+		if(isDirectory)
+			subdirs.push_back(directory.empty() ? std::string(de->d_name) : directory + "/" + de->d_name);
+		else
+		{
+			path.assign(prefix).append(de->d_name);
+			bool exists = false;
+			if(rootDirFd != -1 && !walk.collIgnore->matches(path))
+			{
+				struct stat st;
+				++statCalls;
+				exists = ::fstatat(rootDirFd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+				if(!exists && !missing(errno))
+				{
+					failure = describe("stat", path, errno);
+					break;
+				}
+				existing += exists;
+			}
+			files.add(path, exists);
+		}
+	}
+	collision_stats().statCalls += statCalls;
+	walk.existing += existing;
+	if(rootDirFd != -1)
+		::close(rootDirFd);
+	::closedir(dir);
+	if(!failure.empty())
+		throw paludis::FSError(failure);
+}
+
+void iterate_over_directory_worker(ImageWalk & walk, FSPathList & files)
+{
+	std::vector<std::string> subdirs;
+	while(true)
+	{
+		std::string directory;
+		{
+			std::unique_lock<std::mutex> lock(walk.mutex);
+			while(walk.pending.empty() && walk.busy != 0)
+				walk.cond.wait(lock);
+			if(walk.pending.empty())
+				return;
+			directory = walk.pending.front();
+			walk.pending.pop_front();
+			++walk.busy;
+		}
+		subdirs.clear();
+		std::exception_ptr error;
+		try
+		{
+			walk_image_directory(walk, directory, subdirs, files);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+/*
+ * The first error stops the walk, it is thrown again once every worker is done
+ */
+		{
+			std::unique_lock<std::mutex> lock(walk.mutex);
+			if(error && !walk.error)
+				walk.error = error;
+			if(walk.error)
+				walk.pending.clear();
+			else
+				walk.pending.insert(walk.pending.end(), subdirs.begin(), subdirs.end());
+			--walk.busy;
+		}
+		walk.cond.notify_all();
+	}
+}
+
+/**
+ * Collect all files recursively in ${IMAGE}
+ * Directories are spread over a bounded pool of workers, files are looked up in ${ROOT}
+ * relative to a descriptor of their directory instead of through their full path
+ * @param image ${IMAGE} directory
+ * @param list List of files
+ * @param collIgnore ${COLLISION_IGNORE} and friends directories
+ * @param root ${ROOT} directory
+ * @param allFiles Also list files of directories missing from ${ROOT}
+ * @return Number of files existing in ${ROOT}, 0 meaning nothing can collide
+ * @throw paludis::FSError if a directory cannot be read, paths missing from ${ROOT} excepted
+ */
+std::size_t iterate_over_directory(const paludis::FSPath& image, FSPathList* list, const CollisionIgnore& collIgnore, std::string root, bool allFiles)
+{
+	ImageWalk walk;
+	walk.imageFd = ::open(paludis::stringify(image).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(walk.imageFd == -1)
+		throw paludis::FSError(describe("open", paludis::stringify(image), errno));
+	walk.rootFd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(walk.rootFd == -1)
+	{
+		int error = errno;
+		::close(walk.imageFd);
+		if(!missing(error) || allFiles)
+			throw paludis::FSError(describe("open", root, error));
+		return 0;
+	}
+	walk.rootPrefix = canonicalize_path(root);
+	if(walk.rootPrefix == "/")
+		walk.rootPrefix.clear();
+	walk.collIgnore = &collIgnore;
+	walk.allFiles = allFiles;
+	walk.pending.push_back("");
+	walk.busy = 0;
+	walk.existing = 0;
+	unsigned int n_procs(std::thread::hardware_concurrency());
+	if (n_procs == 0)
+		n_procs = 1;
+	std::vector<FSPathList> files(n_procs);
+	{
+		paludis::ThreadPool pool;
+		for (int n(0), n_end(n_procs) ; n != n_end ; ++n)
+			pool.create_thread(std::bind(&iterate_over_directory_worker, std::ref(walk), std::ref(files[n])));
+	}
+	::close(walk.rootFd);
+	::close(walk.imageFd);
+	if(walk.error)
+		std::rethrow_exception(walk.error);
+	for(std::vector<FSPathList>::const_iterator f(files.begin()), f_end(files.end()); f != f_end; ++f)
+		list->append(*f);
+	list->sort();
+	return walk.existing;
+}
+
+/**
+ * Compare ${IMAGE} files list with installed package files list
+ * @param imageList ${IMAGE} files list
+ * @param pkgList installed package files list, as canonical paths
+ * @param resolver Resolver shared with the installed package files list
+ * @param failFast Stop once that many colliding files are confirmed, files left unchecked
+ *                 are then no longer considered colliding, 0 to check everything
+ * @return true if empty or no colliding files left
+ */
+bool compareFilesList(FSPathList& imageList, ContentsList& pkgList, PathResolver& resolver, std::size_t failFast)
+{
+//	std::cout << "Comparison..." << std::endl;
+    bool returnBool = true;
+    int count = 0;
+    std::size_t confirmed = 0;
+    if(!imageList.empty())
+    {
+    	std::cout << imageList.size() << " files to check" << std::endl;
+        for(FSPathList::iterator imgFS(imageList.begin()), imgFS_end(imageList.end()); imgFS != imgFS_end; ++imgFS)
+        {
+			count++;
+			if(count > 0 && count % 500 == 0)
+				std::cout << "...on " << count << "th target..." << std::endl;
+			// For all files that exists
+            if(imgFS->collides)
+            {
+				std::string realPath(resolver.resolve(imageList.pathString(*imgFS)));
+				if(pkgList.count(realPath) != 0)
+					imgFS->collides = false;
+				else
+				{
+					returnBool = false;
+					if(++confirmed == failFast)
+					{
+						std::cout << "Stopping after " << confirmed << " collisions" << std::endl;
+						for(++imgFS; imgFS != imgFS_end; ++imgFS)
+							imgFS->collides = false;
+						break;
+					}
+				}
+            }
+        }
+    }
+	return returnBool;
+}
+
+namespace
+{
+	/**
+	 * Compare the contents of two files of the same size
+	 * @param first First file
+	 * @param second Second file
+	 * @return whether both files were read and hold the same bytes, reading stops at the first difference
+	 */
+	bool same_contents(const std::string & first, const std::string & second)
+	{
+		std::ifstream a(first.c_str(), std::ios::binary), b(second.c_str(), std::ios::binary);
+		if(!a || !b)
+			return false;
+		std::vector<char> bufferA(65536), bufferB(65536);
+		while(true)
+		{
+			a.read(&bufferA[0], bufferA.size());
+			b.read(&bufferB[0], bufferB.size());
+			if(a.gcount() != b.gcount() || a.bad() || b.bad())
+				return false;
+			if(std::memcmp(&bufferA[0], &bufferB[0], a.gcount()) != 0)
+				return false;
+			if(a.eof() || b.eof())
+				return a.eof() && b.eof();
+		}
+	}
+
+	/**
+	 * Check whether a file of ${IMAGE} is byte-identical to the file it collides with in ${ROOT}
+	 * Only regular files are compared, sizes first so that most different files are not read,
+	 * then their bytes
+	 * @param imagePath File in ${IMAGE}
+	 * @param rootPath File in ${ROOT}
+	 * @return whether both files have the same contents
+	 */
+	bool identical_files(const std::string & imagePath, const std::string & rootPath)
+	{
+		struct stat imageStat, rootStat;
+		++collision_stats().statCalls;
+		if(::lstat(imagePath.c_str(), &imageStat) != 0)
+			return false;
+		++collision_stats().statCalls;
+		if(::lstat(rootPath.c_str(), &rootStat) != 0)
+			return false;
+		if(!S_ISREG(imageStat.st_mode) || !S_ISREG(rootStat.st_mode) || imageStat.st_size != rootStat.st_size)
+			return false;
+		return same_contents(imagePath, rootPath);
+	}
+}
+
+/**
+ * Drop colliding files whose contents are identical to the installed ones
+ * Such files are benign duplicates and need no owner search. Files are compared in parallel,
+ * in batches when only the first colliding files are wanted, so that identical files never
+ * count towards the fail-fast limit.
+ * @param imageList ${IMAGE} files list, identical files are no longer considered colliding
+ * @param image ${IMAGE} directory
+ * @param root ${ROOT} directory
+ * @param failFast Stop once that many files are found to differ, files left unchecked
+ *                 are then no longer considered colliding, 0 to check everything
+ * @param duplicates Paths of identical files, sorted
+ * @return Number of colliding files left
+ */
+std::size_t drop_identical_files(FSPathList & imageList, const std::string & image, std::string root, std::size_t failFast, std::vector<std::string> & duplicates)
+{
+	std::string imagePrefix(canonicalize_path(image));
+	std::string rootPrefix(canonicalize_path(root));
+	if(rootPrefix == "/")
+		rootPrefix.clear();
+	std::vector<FSPathList::iterator> candidates;
+	for(FSPathList::iterator f(imageList.begin()), f_end(imageList.end()); f != f_end; ++f)
+		if(f->collides)
+			candidates.push_back(f);
+	std::vector<char> identical(candidates.size(), 0);
+	WorkStealingPool pool;
+	std::size_t batch = failFast == 0 ? candidates.size() : std::max<std::size_t>(failFast, 4 * pool.workers());
+	std::size_t left = 0, done = 0;
+	while(done != candidates.size())
+	{
+		std::size_t first = done;
+		done = std::min(candidates.size(), first + batch);
+		pool.run(done - first, [&] (unsigned int, std::size_t n)
+		{
+			std::string path(imageList.pathString(*candidates[first + n]));
+			identical[first + n] = identical_files(imagePrefix + path.substr(rootPrefix.size()), path);
+		});
+		for(std::size_t n(first); n != done; ++n)
+		{
+			if(identical[n])
+			{
+				candidates[n]->collides = false;
+				duplicates.push_back(imageList.pathString(*candidates[n]));
+			}
+			else if(++left == failFast)
+			{
+				std::cout << "Stopping after " << left << " collisions" << std::endl;
+				for(++n; n != candidates.size(); ++n)
+					candidates[n]->collides = false;
+				done = candidates.size();
+				break;
+			}
+		}
+	}
+	collision_stats().identicalFiles += duplicates.size();
+	return left;
+}
+
+/**
+ * Find owners of colliding files with the persistent owner index
+ * @param installed Installed packages
+ * @param indexFile Location of the index
+ * @param depSpec PackageDepSpec of the installing package, used for orphaned files
+ * @param imageList ${IMAGE} files list
+ * @param collisions Collisions map
+ */
+void find_owners_in_index(const InstalledPackages & installed, const std::string & indexFile, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, const FSPathList & imageList, FilesByPackage & collisions)
+{
+	std::string orphans(paludis::stringify(*depSpec));
+	OwnerIndex index(indexFile);
+	index.load();
+	if(index.refresh(installed))
+		index.save();
+	for(FSPathList::const_iterator file(imageList.begin()), file_end(imageList.end()); file != file_end; ++file)
+	{
+		if(!file->collides)
+			continue;
+		std::string path(imageList.pathString(*file));
+		const std::string * owner(index.find(path));
+		collisions[owner ? *owner : orphans].push_back(paludis::FSPath(path));
+	}
+}
+
+/**
+ * Find owners of colliding files by asking collision_owner_daemon
+ * @param socketFile Socket of the daemon
+ * @param env Environment, the daemon must serve the same installed repositories
+ * @param root ${ROOT} directory, the daemon must serve the same one
+ * @param depSpec PackageDepSpec of the installing package, used for orphaned files
+ * @param imageList ${IMAGE} files list
+ * @param collisions Collisions map, left alone when the daemon did not answer
+ * @return whether the daemon answered
+ */
+bool find_owners_from_daemon(const std::string & socketFile, const paludis::Environment * env, const std::string & root, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, const FSPathList & imageList, FilesByPackage & collisions)
+{
+	std::vector<std::string> paths, owners;
+	for(FSPathList::const_iterator file(imageList.begin()), file_end(imageList.end()); file != file_end; ++file)
+		if(file->collides)
+			paths.push_back(imageList.pathString(*file));
+	if(!OwnerClient(socketFile).query(root, installed_repositories(env), paths, owners))
+		return false;
+	std::string orphans(paludis::stringify(*depSpec));
+	for(std::size_t n(0), n_end(paths.size()); n != n_end; ++n)
+		collisions[owners[n].empty() ? orphans : owners[n]].push_back(paludis::FSPath(paths[n]));
+	return true;
+}
+
+void find_owners_in_package(OwnerSearch & search, const InstalledPackages & installed, std::size_t n, OwnerHits & hits)
+{
+	try
+	{
+		OwnerFinder finder(search, n, &hits);
+		unsigned long entries = 0;
+		installed.visitContents(n, [&finder, &entries] (const char * path, std::size_t length) { ++entries; finder.find(path, length); });
+		++collision_stats().packagesScanned;
+		collision_stats().contentsEntries += entries;
+	}
+	catch (paludis::ConfigurationError &ex)
+	{
+	//	std::cout << "Error: " << ex.message() << std::endl;
+	//	std::cout << ex.backtrace("\n") << std::endl;
+	}
+}
+
+/**
+ * Find owners of all colliding files in a single pass over the installed packages
+ * Packages are spread over a work-stealing pool, each worker keeps
+ * its own hits and they are only merged once every worker is done.
+ * A package is skipped once every file has an owner before it, so that
+ * the owner kept does not depend on the order workers read packages in
+ * @param installed Installed packages
+ * @param depSpec PackageDepSpec of the installing package, used for orphaned files
+ * @param imageList ${IMAGE} files list
+ * @param collisions Collisions map
+ */
+void find_owners(const InstalledPackages & installed, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, const FSPathList & imageList, FilesByPackage & collisions)
+{
+	OwnerSearch search(imageList, installed.size());
+	WorkStealingPool pool;
+	std::vector<OwnerHits> hits(pool.workers());
+	pool.run(installed.size(),
+		[&search, &installed, &hits] (unsigned int worker, std::size_t n)
+		{
+			if(!search.settled(n))
+				find_owners_in_package(search, installed, n, hits[worker]);
+		});
+/*
+ * Keep the first package in repository order when a file has several owners,
+ * files nobody owns are added to installing PackageID as orphaned
+ */
+	std::vector<std::size_t> owners(search.paths.size(), installed.size());
+	for(std::vector<OwnerHits>::const_iterator h(hits.begin()), h_end(hits.end()); h != h_end; ++h)
+		for(OwnerHits::const_iterator hit(h->begin()), hit_end(h->end()); hit != hit_end; ++hit)
+			owners[hit->first] = std::min(owners[hit->first], hit->second);
+	std::unordered_map<std::size_t, std::vector<paludis::FSPath> *> files;
+	for(std::size_t n(0), n_end(search.paths.size()); n != n_end; ++n)
+	{
+		std::vector<paludis::FSPath> * & ownerFiles(files[owners[n]]);
+		if(!ownerFiles)
+			ownerFiles = &collisions[paludis::stringify(owners[n] == installed.size() ? *depSpec : *installed.depSpec(owners[n]))];
+		ownerFiles->push_back(paludis::FSPath(search.paths[n]));
+	}
+}
+
+namespace
+{
+	typedef std::vector<FilesByPackage::const_iterator> SortedCollisions;
+
+	SortedCollisions sort_collisions(const FilesByPackage & collisions)
+	{
+		SortedCollisions sorted;
+		for(FilesByPackage::const_iterator file(collisions.begin()), file_end(collisions.end()); file != file_end; ++file)
+			sorted.push_back(file);
+		std::sort(sorted.begin(), sorted.end(), [] (FilesByPackage::const_iterator a, FilesByPackage::const_iterator b) { return a->first < b->first; });
+		return sorted;
+	}
+
+	/**
+	 * Read the target of a colliding file when it is a symlink
+	 * @return whether the file is a symlink
+	 */
+	bool symlink_target(const std::string & path, std::string & target)
+	{
+		struct stat st;
+		char buffer[PATH_MAX];
+		ssize_t length;
+		if(::lstat(path.c_str(), &st) != 0 || !S_ISLNK(st.st_mode) || (length = ::readlink(path.c_str(), buffer, sizeof(buffer))) <= 0)
+			return false;
+		target.assign(buffer, length);
+		return true;
+	}
+
+	void write_json_string(std::ostream & out, const std::string & value)
+	{
+		out << '"';
+		for(std::string::const_iterator c(value.begin()), c_end(value.end()); c != c_end; ++c)
+		{
+			switch(*c)
+			{
+				case '"':
+					out << "\\\"";
+					break;
+				case '\\':
+					out << "\\\\";
+					break;
+				case '\n':
+					out << "\\n";
+					break;
+				case '\t':
+					out << "\\t";
+					break;
+				default:
+					if(static_cast<unsigned char>(*c) < 0x20)
+					{
+						char escaped[8];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+						out << escaped;
+					}
+					else
+						out << *c;
+			}
+		}
+		out << '"';
+	}
+
+	void print_owner(std::ostream & out, const std::string & owner, const std::string & orphans)
+	{
+		if(owner == orphans)
+			out << "	Orphaned files";
+		else
+			out << "	" << owner;
+	}
+
+	/**
+	 * List colliding files, with the target of symlinks
+	 * @param limit Maximum number of files listed
+	 */
+	void list_collisions(std::ostream & out, const SortedCollisions & sorted, const std::string & orphans, std::size_t limit)
+	{
+		for(SortedCollisions::const_iterator s(sorted.begin()), s_end(sorted.end()); s != s_end && limit != 0; ++s)
+		{
+			print_owner(out, (*s)->first, orphans);
+			out << " :\n";
+			for(std::vector<paludis::FSPath>::const_iterator fs((*s)->second.begin()), fs_end((*s)->second.end()); fs != fs_end && limit != 0; ++fs, --limit)
+			{
+				std::string path(paludis::stringify(*fs)), target;
+				out << "		" << path;
+				if(symlink_target(path, target))
+					out << " -> " << target;
+				out << "\n";
+			}
+		}
+	}
+
+	std::string parent_directory(const std::string & path)
+	{
+		std::string::size_type slash = path.rfind('/');
+		return slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+	}
+
+	std::size_t depth(const std::string & path)
+	{
+		return path == "/" ? 0 : std::count(path.begin(), path.end(), '/');
+	}
+
+	/**
+	 * Merge every subtree lying inside another one into it
+	 * @param subtrees Subtrees with their number of files, left disjoint
+	 */
+	void merge_nested_subtrees(std::map<std::string, std::size_t> & subtrees)
+	{
+		for(std::map<std::string, std::size_t>::iterator t(subtrees.begin()); t != subtrees.end(); )
+		{
+			std::map<std::string, std::size_t>::iterator ancestor(subtrees.end());
+			for(std::string dir(t->first); dir != "/" && ancestor == subtrees.end(); )
+			{
+				dir = parent_directory(dir);
+				ancestor = subtrees.find(dir);
+			}
+			if(ancestor == subtrees.end())
+				++t;
+			else
+			{
+				ancestor->second += t->second;
+				subtrees.erase(t++);
+			}
+		}
+	}
+
+	/**
+	 * Count files of an owner by directory subtree
+	 * Files are counted by directory. The deepest subtrees are then merged into their parent,
+	 * one level at a time, until few enough are left. Subtrees listed are disjoint and
+	 * count every file below them.
+	 * @param files Files of the owner
+	 * @param maxSubtrees Number of subtrees wanted
+	 * @return Subtrees with their number of files, most files first
+	 */
+	std::vector<std::pair<std::string, std::size_t> > count_subtrees(const std::vector<paludis::FSPath> & files, std::size_t maxSubtrees)
+	{
+		std::map<std::string, std::size_t> subtrees;
+		for(std::vector<paludis::FSPath>::const_iterator fs(files.begin()), fs_end(files.end()); fs != fs_end; ++fs)
+			++subtrees[parent_directory(paludis::stringify(*fs))];
+		merge_nested_subtrees(subtrees);
+		while(subtrees.size() > maxSubtrees)
+		{
+			std::size_t deepest = 0;
+			for(std::map<std::string, std::size_t>::const_iterator t(subtrees.begin()), t_end(subtrees.end()); t != t_end; ++t)
+				deepest = std::max(deepest, depth(t->first));
+			if(deepest == 0)
+				break;
+			std::map<std::string, std::size_t> merged;
+			for(std::map<std::string, std::size_t>::const_iterator t(subtrees.begin()), t_end(subtrees.end()); t != t_end; ++t)
+				merged[depth(t->first) == deepest ? parent_directory(t->first) : t->first] += t->second;
+			merge_nested_subtrees(merged);
+			subtrees.swap(merged);
+		}
+		std::vector<std::pair<std::string, std::size_t> > sorted(subtrees.begin(), subtrees.end());
+		std::sort(sorted.begin(), sorted.end(), [] (const std::pair<std::string, std::size_t> & a, const std::pair<std::string, std::size_t> & b) { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+		return sorted;
+	}
+}
+
+/**
+ * Show each package and files involved in collision
+ * Packages are shown in the order of their PackageDepSpec. Past limit files, collisions are
+ * summarised by owner and directory subtree and only the first limit files are listed.
+ * @param out Stream to write to
+ * @param collisions Collisions map
+ * @param depSpec PackageDepSpec of the installing package, holding orphaned files
+ * @param limit Number of files listed in full
+ */
+void print_collisions(std::ostream & out, const FilesByPackage & collisions, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, std::size_t limit)
+{
+	std::string orphans(paludis::stringify(*depSpec));
+	SortedCollisions sorted(sort_collisions(collisions));
+	std::size_t total = 0;
+	for(SortedCollisions::const_iterator s(sorted.begin()), s_end(sorted.end()); s != s_end; ++s)
+		total += (*s)->second.size();
+	std::ostringstream report;
+	if(total <= limit)
+	{
+		report << "Detected collisions :\n";
+		list_collisions(report, sorted, orphans, total);
+	}
+	else
+	{
+		report << "Detected collisions : " << total << " files\n";
+		for(SortedCollisions::const_iterator s(sorted.begin()), s_end(sorted.end()); s != s_end; ++s)
+		{
+			print_owner(report, (*s)->first, orphans);
+			report << " : " << (*s)->second.size() << " files\n";
+			std::vector<std::pair<std::string, std::size_t> > subtrees(count_subtrees((*s)->second, 10));
+			for(std::vector<std::pair<std::string, std::size_t> >::const_iterator t(subtrees.begin()), t_end(subtrees.end()); t != t_end; ++t)
+				report << "		" << t->first << " : " << t->second << " files\n";
+		}
+		report << "First " << limit << " colliding files :\n";
+		list_collisions(report, sorted, orphans, limit);
+	}
+	out << report.str() << std::flush;
+}
+
+/**
+ * Write the complete list of collisions to a file, in a single write
+ * @param file File to write
+ * @param collisions Collisions map
+ * @param depSpec PackageDepSpec of the installing package, holding orphaned files
+ * @return whether the file was written
+ */
+bool write_collisions(const std::string & file, const FilesByPackage & collisions, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec)
+{
+	std::ostringstream report;
+	report << "Collisions of " << *depSpec << " :\n";
+	list_collisions(report, sort_collisions(collisions), paludis::stringify(*depSpec), std::numeric_limits<std::size_t>::max());
+	std::string data(report.str());
+	std::ofstream out(file.c_str());
+	out.write(data.data(), data.size());
+	out.flush();
+	return static_cast<bool>(out);
+}
+
+/**
+ * Write collisions as JSON for tools, replacing the file at once
+ * Owners are given as their PackageDepSpec, files of nobody are listed as orphans
+ * @param file File to write
+ * @param collisions Collisions map, empty when the package does not collide
+ * @param depSpec PackageDepSpec of the installing package, holding orphaned files
+ * @param truncated Whether fail-fast stopped the check before every collision was found
+ * @return whether the file was written
+ */
+bool write_json_report(const std::string & file, const FilesByPackage & collisions, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, bool truncated)
+{
+	std::string orphans(paludis::stringify(*depSpec));
+	SortedCollisions sorted(sort_collisions(collisions));
+	std::size_t total = 0;
+	for(SortedCollisions::const_iterator s(sorted.begin()), s_end(sorted.end()); s != s_end; ++s)
+		total += (*s)->second.size();
+	std::ostringstream report;
+	report << "{\"package\":";
+	write_json_string(report, orphans);
+	report << ",\"collisions\":" << total << ",\"truncated\":" << (truncated ? "true" : "false") << ",\"owners\":[";
+	std::ostringstream orphaned;
+	bool firstOwner = true;
+	for(SortedCollisions::const_iterator s(sorted.begin()), s_end(sorted.end()); s != s_end; ++s)
+	{
+		std::ostringstream & out((*s)->first == orphans ? orphaned : report);
+		if(&out == &report)
+		{
+			report << (firstOwner ? "" : ",") << "{\"owner\":";
+			write_json_string(report, (*s)->first);
+			report << ",\"files\":";
+			firstOwner = false;
+		}
+		out << "[";
+		for(std::vector<paludis::FSPath>::const_iterator fs((*s)->second.begin()), fs_end((*s)->second.end()); fs != fs_end; ++fs)
+		{
+			std::string path(paludis::stringify(*fs)), target;
+			out << (fs == (*s)->second.begin() ? "" : ",") << "{\"path\":";
+			write_json_string(out, path);
+			if(symlink_target(path, target))
+			{
+				out << ",\"target\":";
+				write_json_string(out, target);
+			}
+			out << "}";
+		}
+		out << "]";
+		if(&out == &report)
+			report << "}";
+	}
+	report << "],\"orphans\":" << (orphaned.str().empty() ? "[]" : orphaned.str()) << "}\n";
+	std::string data(report.str());
+	std::ostringstream tmpFile;
+	tmpFile << file << ".tmp." << ::getpid();
+	std::ofstream out(tmpFile.str().c_str(), std::ios::binary);
+	out.write(data.data(), data.size());
+	out.close();
+	if(!out || ::rename(tmpFile.str().c_str(), file.c_str()) != 0)
+	{
+		::unlink(tmpFile.str().c_str());
+		return false;
+	}
+	return true;
+}
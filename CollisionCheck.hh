@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COLLISION_CHECK_HH__
+#define __COLLISION_CHECK_HH__
+
+#include <limits>
+#include <ostream>
+#include <string>
+
+#include "CollisionIgnore.hh"
+#include "CollisionProtect.hh"
+#include "InstalledPackages.hh"
+#include "PathResolver.hh"
+
+/**
+ * Phases of the collision check, shared by the hook and the benchmark
+ */
+std::size_t iterate_over_directory(const paludis::FSPath &, FSPathList *, const CollisionIgnore &, std::string, bool = false);
+bool compareFilesList(FSPathList &, ContentsList &, PathResolver &, std::size_t = 0);
+std::size_t drop_identical_files(FSPathList &, const std::string &, std::string, std::size_t, std::vector<std::string> &);
+void find_owners(const InstalledPackages &, const std::shared_ptr<const paludis::PackageDepSpec> &, const FSPathList &, FilesByPackage &);
+void find_owners_in_index(const InstalledPackages &, const std::string &, const std::shared_ptr<const paludis::PackageDepSpec> &, const FSPathList &, FilesByPackage &);
+bool find_owners_from_daemon(const std::string &, const paludis::Environment *, const std::string &, const std::shared_ptr<const paludis::PackageDepSpec> &, const FSPathList &, FilesByPackage &);
+void print_collisions(std::ostream &, const FilesByPackage &, const std::shared_ptr<const paludis::PackageDepSpec> &, std::size_t = std::numeric_limits<std::size_t>::max());
+bool write_collisions(const std::string &, const FilesByPackage &, const std::shared_ptr<const paludis::PackageDepSpec> &);
+bool write_json_report(const std::string &, const FilesByPackage &, const std::shared_ptr<const paludis::PackageDepSpec> &, bool);
+
+#endif // __COLLISION_CHECK_HH__
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "CanonicalPath.hh"
+#include "CollisionIgnore.hh"
+
+namespace
+{
+	int compare_component(const std::string & name, const char * component, std::size_t length)
+	{
+		int result = std::memcmp(name.data(), component, std::min(name.size(), length));
+		if(result != 0)
+			return result;
+		return name.size() < length ? -1 : (name.size() > length ? 1 : 0);
+	}
+}
+
+CollisionIgnore::CollisionIgnore(const std::vector<std::string> & entries) :
+    nodes(1)
+{
+	for(std::vector<std::string>::const_iterator entry(entries.begin()), entry_end(entries.end()); entry != entry_end; ++entry)
+		insert(*entry);
+}
+
+void CollisionIgnore::insert(const std::string & rawEntry)
+{
+	// Paths checked are always absolute
+	if(rawEntry.empty() || rawEntry[0] != '/')
+		return;
+	// A trailing slash restricts the entry to a directory, keep it
+	std::string entry(canonicalize_path(rawEntry));
+	if(rawEntry[rawEntry.size() - 1] == '/' && entry != "/")
+		entry += "/";
+	std::size_t node = 0;
+	std::string::size_type pos = 1;
+	while(true)
+	{
+		std::string::size_type slash = entry.find('/', pos);
+		if(slash == std::string::npos)
+		{
+			nodes[node].prefixes.push_back(entry.substr(pos));
+			return;
+		}
+		std::size_t next = child(node, entry.data() + pos, slash - pos);
+		if(next == 0)
+		{
+			next = nodes.size();
+			std::vector<std::pair<std::string, std::size_t> > & children(nodes[node].children);
+			std::pair<std::string, std::size_t> newChild(entry.substr(pos, slash - pos), next);
+			children.insert(std::lower_bound(children.begin(), children.end(), newChild), newChild);
+			nodes.push_back(Node());
+		}
+		node = next;
+		pos = slash + 1;
+	}
+}
+
+/**
+ * Find a child of a node
+ * @return Index of the child, 0 if there is none
+ */
+std::size_t CollisionIgnore::child(std::size_t node, const char * component, std::size_t length) const
+{
+	const std::vector<std::pair<std::string, std::size_t> > & children(nodes[node].children);
+	std::size_t low = 0, high = children.size();
+	while(low < high)
+	{
+		std::size_t middle = low + (high - low) / 2;
+		int result = compare_component(children[middle].first, component, length);
+		if(result == 0)
+			return children[middle].second;
+		if(result < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return 0;
+}
+
+bool CollisionIgnore::matches(const std::string & path) const
+{
+	return matches(path.data(), path.size());
+}
+
+/**
+ * Check whether a path is in ${COLLISION_IGNORE} and friends
+ * @param path Path to check
+ * @param length Length of the path
+ * @return whether an entry is a prefix of the path
+ */
+bool CollisionIgnore::matches(const char * path, std::size_t length) const
+{
+	if(length == 0 || path[0] != '/')
+		return false;
+	std::size_t node = 0;
+	std::size_t pos = 1;
+	while(true)
+	{
+		const char * slash = static_cast<const char *>(std::memchr(path + pos, '/', length - pos));
+		std::size_t end = slash ? slash - path : length;
+		const std::vector<std::string> & prefixes(nodes[node].prefixes);
+		for(std::vector<std::string>::const_iterator prefix(prefixes.begin()), prefix_end(prefixes.end()); prefix != prefix_end; ++prefix)
+			if(prefix->size() <= end - pos && std::memcmp(prefix->data(), path + pos, prefix->size()) == 0)
+				return true;
+		if(end == length)
+			return false;
+		node = child(node, path + pos, end - pos);
+		if(node == 0)
+			return false;
+		pos = end + 1;
+	}
+}
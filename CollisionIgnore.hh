@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COLLISION_IGNORE_HH__
+#define __COLLISION_IGNORE_HH__
+
+#include <string>
+#include <vector>
+
+/**
+ * ${COLLISION_IGNORE} and friends compiled into a trie of path components
+ * A path matches when one of the entries is a string prefix of it, the last
+ * component of an entry being matched as a prefix of the path component.
+ * Matching the dirname of a file is covered since it is a prefix of the file.
+ */
+class CollisionIgnore
+{
+    public:
+        CollisionIgnore(const std::vector<std::string> &);
+        bool matches(const std::string &) const;
+        bool matches(const char *, std::size_t) const;
+    private:
+        struct Node
+        {
+            std::vector<std::string> prefixes;
+            std::vector<std::pair<std::string, std::size_t> > children;
+        };
+        void insert(const std::string &);
+        std::size_t child(std::size_t, const char *, std::size_t) const;
+        std::vector<Node> nodes;
+};
+
+#endif // __COLLISION_IGNORE_HH__
@@ -20,20 +20,29 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 
 #include <paludis/paludis.hh>
 
 #include <memory>
-#include <thread>
 #include <typeinfo>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "pstream.h"
 
+#include "CanonicalPath.hh"
 #include "ContentsVisitorForIPFL.hh"
+#include "CollisionCheck.hh"
+#include "CollisionIgnore.hh"
 #include "CollisionProtect.hh"
-#include "OwnerFinder.hh"
+#include "CollisionStats.hh"
+#include "InstalledPackages.hh"
 
 //const std::shared_ptr<const paludis::Sequence<std::string> > paludis_hook_auto_phases(const paludis::Environment *env)
 //{
@@ -42,27 +51,6 @@
 //	return phases;
 //}
 
-std::string canonicalize_path(std::string path)
-{
-	size_t pos = path.find("/../");
-	if(pos >= 3)
-	{
-		while(pos != std::string::npos)
-		{
-			size_t pos2 = path.rfind("/", pos - 1);
-			path.erase(pos2, pos - pos2 + 3);
-			pos = path.find("/../");
-		}
-	}
-	pos = path.find("//");
-	while(pos != std::string::npos)
-	{
-		path.erase(pos, 1);
-		pos = path.find("//");
-	}
-	return path;
-}
-
 /**
 * Get an environment variable defined in bashrc_files() like /etc/paludis/bashrc
 * @param hook Current hook
@@ -82,48 +70,109 @@ std::string get_envvar_from_bashrc(const paludis::Hook& hook, const std::string&
 	return buffer;
 }
 
- /**
- * Check whether a file reside in a directory of COLLISION_IGNORE
- * @param file File to check
- * @param vector COLLISION_IGNORE directories
- * @return whether file is in a COLLISION_IGNORE directory or not
+/**
+ * Find out GCC DataInfoDir
+ * @return GCC DataInfoDir
+ */
+std::string findGccDataInfoDir()
+{
+	std::string gccMachine;
+	std::string gccVersion;
+	paludis::FSPath gccDataInfoDir("/usr/share/gcc-data");
+	redi::ipstream cmd_ss("gcc -dumpmachine");
+	getline(cmd_ss, gccMachine);
+	redi::ipstream cmd_ss2("gcc -dumpversion");
+	getline(cmd_ss2, gccVersion);
+	gccDataInfoDir /= gccMachine;
+	gccDataInfoDir /= gccVersion;
+	gccDataInfoDir /= "info";
+//	std::cout << gccDataInfoDir << std::endl;
+	return gccDataInfoDir.stat().exists() ? paludis::stringify(gccDataInfoDir) : "";
+}
+
+/**
+ * Get the directory holding the caches of the hook
+ * @return Cache directory
+ */
+std::string collision_protect_cache_dir()
+{
+	return paludis::getenv_with_default("COLLISION_PROTECT_CACHE_DIR", "/var/cache/paludis/collision-protect");
+}
+
+/**
+ * Describe the state of a file for the configuration cache key
+ * @param file File to describe
+ * @return Path, inode and modification time of the file
+ */
+std::string file_stamp(const std::string & file)
+{
+	std::ostringstream stamp;
+	struct stat st;
+	stamp << file;
+	if(::stat(file.c_str(), &st) == 0)
+		stamp << ":" << st.st_dev << ":" << st.st_ino << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+	else
+		stamp << ":-";
+	return stamp.str();
+}
+
+/**
+ * Find the gcc that "gcc -dumpmachine" would run
+ * @return Path of gcc, empty if not in ${PATH}
  */
-bool is_in_collision_ignore(const paludis::FSPath& file, std::vector<std::string>& vector)
+std::string find_gcc_in_path()
 {
-	bool returnBool = false;
-	for(std::vector<std::string>::const_iterator path(vector.begin()), path_end(vector.end()); path != path_end; ++path)
+	std::istringstream path_ss(paludis::getenv_with_default("PATH", ""));
+	std::string dir;
+	while(getline(path_ss, dir, ':'))
 	{
-		if(paludis::stringify(file.dirname()).find(*path, 0) == 0 || paludis::stringify(file).find(*path, 0) == 0)
-		{
-			returnBool = true;
-			break;
-		}
+		std::string gcc((dir.empty() ? "." : dir) + "/gcc");
+		if(::access(gcc.c_str(), X_OK) == 0)
+			return gcc;
 	}
-	return returnBool;
+	return "";
 }
 
 /**
- * Collect all files recursively in a directory
- * @param directory Directory to start collecting from
- * @param path_to_strip Leading path to remove
- * @param list List of files
- * @param collIgnore ${COLLISION_IGNORE} and friends directories
+ * Resolve ${COLLISION_IGNORE} and GCC DataInfoDir, which both need to spawn processes
+ * The result is cached and only resolved again when the bashrc files, gcc, ${PATH}
+ * or ${COLLISION_IGNORE} in the environment of the hook change.
+ * Files sourced by the bashrc files are not tracked, set ${COLLISION_PROTECT_CACHE_DIR}
+ * elsewhere or remove the cache after editing them.
+ * @param hook Current hook
+ * @param collisionIgnore Value of ${COLLISION_IGNORE}
+ * @param gccDataInfoDir GCC DataInfoDir
  */
-void iterate_over_directory(const paludis::FSPath& directory, const paludis::FSPath& path_to_strip, FSPathList* list, std::vector<std::string>& collIgnore, std::string root)
+void resolve_config(const paludis::Hook& hook, std::string& collisionIgnore, std::string& gccDataInfoDir)
 {
-	for(paludis::FSIterator fsi(directory, {}), fsi_end; fsi != fsi_end; ++fsi)
+	std::ostringstream key;
+	std::istringstream bashrc_ss(hook.get("PALUDIS_BASHRC_FILES"));
+	std::string buffer;
+	while(bashrc_ss >> buffer)
+		key << file_stamp(buffer) << " ";
+	key << file_stamp(find_gcc_in_path()) << " " << paludis::getenv_with_default("PATH", "");
+	std::istringstream environment_ss(paludis::getenv_with_default("COLLISION_IGNORE", ""));
+	key << " COLLISION_IGNORE=";
+	while(environment_ss >> buffer)
+		key << buffer << ":";
+	std::string cacheFile(collision_protect_cache_dir() + "/config");
 	{
-		if(fsi->stat().is_directory())
-			iterate_over_directory(*fsi, path_to_strip, list, collIgnore, root);
-		else
-		{
-			paludis::FSPath path(paludis::FSPath(root)/fsi->strip_leading(path_to_strip));
-			if(is_in_collision_ignore(path, collIgnore))
-				list->insert(std::make_pair(paludis::stringify(path), false));
-			else
-				list->insert(std::make_pair(paludis::stringify(path), path.stat().exists()));
-		}
+		std::ifstream in(cacheFile.c_str());
+		std::string cachedKey;
+		if(getline(in, cachedKey) && cachedKey == key.str() && getline(in, collisionIgnore) && getline(in, gccDataInfoDir))
+			return;
+	}
+	collisionIgnore = get_envvar_from_bashrc(hook, "COLLISION_IGNORE");
+	gccDataInfoDir = findGccDataInfoDir();
+	::mkdir(collision_protect_cache_dir().c_str(), 0755);
+	std::ostringstream tmpFile;
+	tmpFile << cacheFile << ".tmp." << ::getpid();
+	{
+		std::ofstream out(tmpFile.str().c_str());
+		out << key.str() << "\n" << collisionIgnore << "\n" << gccDataInfoDir << "\n";
 	}
+	if(::rename(tmpFile.str().c_str(), cacheFile.c_str()) != 0)
+		::unlink(tmpFile.str().c_str());
 }
 
 /**
@@ -143,71 +192,100 @@ void fill_collision_ignore_with_variable(std::vector<std::string> *vector, std::
 }
 
 /**
- * Find out GCC DataInfoDir
- * @return GCC DataInfoDir
+ * Fill the COLLISION_IGNORE vector with every directory the check skips, for the hook and the tools alike
+ * @param vector The actual COLLISION_IGNORE vector
+ * @param collisionIgnore Value of ${COLLISION_IGNORE}
+ * @param configProtectMask Value of ${CONFIG_PROTECT_MASK}
+ * @param configProtect Value of ${CONFIG_PROTECT}
+ * @param gccDataInfoDir GCC DataInfoDir, may be empty
  */
-std::string findGccDataInfoDir()
+void fill_collision_ignore(std::vector<std::string> *vector, const std::string & collisionIgnore, const std::string & configProtectMask, const std::string & configProtect, const std::string & gccDataInfoDir)
 {
-	std::string gccMachine;
-	std::string gccVersion;
-	paludis::FSPath gccDataInfoDir("/usr/share/gcc-data");
-	redi::ipstream cmd_ss("gcc -dumpmachine");
-	getline(cmd_ss, gccMachine);
-	redi::ipstream cmd_ss2("gcc -dumpversion");
-	getline(cmd_ss2, gccVersion);
-	gccDataInfoDir /= gccMachine;
-	gccDataInfoDir /= gccVersion;
-	gccDataInfoDir /= "info";
-//	std::cout << gccDataInfoDir << std::endl;
-	return gccDataInfoDir.stat().exists() ? paludis::stringify(gccDataInfoDir) : "";
+	fill_collision_ignore_with_variable(vector, collisionIgnore);
+	fill_collision_ignore_with_variable(vector, configProtectMask);
+	fill_collision_ignore_with_variable(vector, configProtect);
+	fill_collision_ignore_with_variable(vector, "/usr/share/info/dir");
+	if(!gccDataInfoDir.empty())
+		fill_collision_ignore_with_variable(vector, gccDataInfoDir + "/dir");
+}
+
+/**
+ * Get location of the persistent owner index
+ * @return Path of the index file, empty if the index is disabled
+ */
+std::string owner_index_file()
+{
+	return paludis::getenv_with_default("COLLISION_PROTECT_INDEX", collision_protect_cache_dir() + "/owners.index");
+}
+
+/**
+ * Socket of collision_owner_daemon, an empty value disables it
+ * @return Location of the socket
+ */
+std::string owner_socket_file()
+{
+	return paludis::getenv_with_default("COLLISION_PROTECT_SOCKET", collision_protect_cache_dir() + "/owners.sock");
+}
+
+/**
+ * Read a count from the environment
+ * Values that are not a whole non-negative number are ignored with a warning
+ * @param name Variable to read
+ * @param defaultValue Count used when the variable is unset or invalid
+ * @return Count
+ */
+std::size_t count_variable(const std::string & name, std::size_t defaultValue)
+{
+	std::string value(paludis::getenv_with_default(name, ""));
+	if(value.empty())
+		return defaultValue;
+	char * end = nullptr;
+	errno = 0;
+	unsigned long long count = std::strtoull(value.c_str(), &end, 10);
+	if(value[0] < '0' || value[0] > '9' || *end != '\0' || errno == ERANGE || count != static_cast<std::size_t>(count))
+	{
+		std::cout << "Ignoring ${" << name << "}=\"" << value << "\", not a non-negative number, using " << defaultValue << std::endl;
+		return defaultValue;
+	}
+	return count;
+}
+
+/**
+ * Get the number of collisions after which the check stops, for builders only needing to know a package collides
+ * @return Limit from ${COLLISION_PROTECT_FAIL_FAST}, 0 when disabled
+ */
+std::size_t fail_fast_limit()
+{
+	return count_variable("COLLISION_PROTECT_FAIL_FAST", 0);
+}
+
+/**
+ * Check whether colliding files identical to the installed ones are dropped before the owner search
+ * @return Whether ${COLLISION_PROTECT_IDENTICAL_CHECK} is set to "yes"
+ */
+bool identical_check()
+{
+	return paludis::getenv_with_default("COLLISION_PROTECT_IDENTICAL_CHECK", "") == "yes";
+}
+
+/**
+ * Get the number of colliding files listed in full on the output, larger sets are summarised
+ * @return Limit from ${COLLISION_PROTECT_REPORT_LIMIT}, 200 by default
+ */
+std::size_t report_limit()
+{
+	return count_variable("COLLISION_PROTECT_REPORT_LIMIT", 200);
 }
 
 /**
- * Compare ${IMAGE} files list with installed package files list
- * @param imageList ${IMAGE} files list
- * @param pkgList installed package files list
- * @return true if empty or no colliding files left
+ * Get location of the complete list of collisions, written when the output is summarised
+ * @param hook Current hook
+ * @return Path of the file, empty if disabled
  */
-bool compareFilesList(FSPathList& imageList, ContentsList& pkgList)
+std::string report_file(const paludis::Hook& hook)
 {
-//	std::cout << "Comparison..." << std::endl;
-    bool returnBool = true;
-    int count = 0;
-    if(!imageList.empty())
-    {
-    	std::cout << imageList.size() << " files to check" << std::endl;
-        for(FSPathList::iterator imgFS(imageList.begin()), imgFS_end(imageList.end()); imgFS != imgFS_end; ++imgFS)
-        {
-			count++;
-			if(count > 0 && count % 500 == 0)
-				std::cout << "...on " << count << "th target..." << std::endl;
-			// For all files that exists
-            if(imgFS->second)
-            {
-                bool isInPkg = false;
-//				std::cout << imgFS->first.realpath_if_exists();
-//				if(imgFS->first.is_symbolic_link())
-//					std::cout << " -> " << imgFS->first.readlink();
-//				std::cout << std::endl;
-				ContentsList::const_iterator pkgFS = find(pkgList.begin(), pkgList.end(), paludis::FSPath(imgFS->first).realpath_if_exists());
-//				std::cout << imgFS->first.realpath_if_exists() << " (" << std::boolalpha << (pkgFS != pkgList.end()) << std::noboolalpha << ")" << std::endl;
-				if(pkgFS != pkgList.end())
-                {
-                    if(paludis::FSPath(imgFS->first).realpath_if_exists() == pkgFS->realpath_if_exists())
-                    {
-//						std::cout << "Found file : " << pkgFS->realpath_if_exists() << std::endl;
-						imgFS->second = false;
-						isInPkg = true;
-                    }
-                }
-//				else
-//					std::cout << "File not found : " << imgFS->first << std::endl;
-                if(!isInPkg)
-                    returnBool = false;
-            }
-        }
-    }
-	return returnBool;
+	return paludis::getenv_with_default("COLLISION_PROTECT_REPORT_FILE",
+		collision_protect_cache_dir() + "/collisions-" + hook.get("CATEGORY") + "-" + hook.get("PN") + "-" + hook.get("PVR") + ".txt");
 }
 
 /**
@@ -225,112 +303,34 @@ bool pkgID_has_contents_file(const std::shared_ptr<const paludis::PackageID>& pk
 }
 
 /**
- * Find PackageID owner of a file
- * @param env Environment
- * @param fileName fileName to check
- * @param collisions Collisions map
- * @return whether file has found its owner or not
+ * Write statistics of the current invocation to ${COLLISION_PROTECT_STATS} if set
+ * @param hook Current hook
  */
-bool find_owner(std::mutex & mutex, const paludis::Environment *& env, std::string fileName, FilesByPackage * collisions)
+void write_stats(const paludis::Hook& hook)
 {
-//	std::cout << "Finding owner of file " << fileName << std::endl;
-	bool found_owner = false;
-	for(paludis::EnvironmentImplementation::RepositoryConstIterator r(env->begin_repositories()), r_end(env->end_repositories()); r != r_end; ++r)
-	{
-		if((*r)->installed_root_key())
-		{
-			std::shared_ptr<const paludis::CategoryNamePartSet> cats((*r)->category_names({}));
-			for(paludis::CategoryNamePartSet::ConstIterator c(cats->begin()), c_end(cats->end()); c != c_end; ++c)
-			{
-				std::shared_ptr<const paludis::QualifiedPackageNameSet> pkgs((*r)->package_names(*c, {}));
-				for(paludis::QualifiedPackageNameSet::ConstIterator p(pkgs->begin()), p_end(pkgs->end()); p != p_end; ++p)
-				{
-					std::shared_ptr<const paludis::PackageIDSequence> ids((*r)->package_ids(*p, {}));
-					for(paludis::PackageIDSequence::ConstIterator v(ids->begin()), v_end(ids->end()); v != v_end; ++v)
-					{
-//						std::cout << (*v)->canonical_form(paludis::idcf_full) << std::endl;
-						if((*v)->contents() && pkgID_has_contents_file(*v))
-						{
-//							std::cout << "Contents found at :" << (*v)->fs_location_key()->parse_value() << std::endl;
-							std::shared_ptr<const paludis::Contents> contents((*v)->contents());
-							std::shared_ptr<const paludis::PackageDepSpec> depSpec = std::make_shared<const paludis::PackageDepSpec>((*v)->uniquely_identifying_spec());
-							OwnerFinder finder(fileName, depSpec, collisions);
-							{
-								std::unique_lock<std::mutex> lock(mutex);
-								std::for_each(paludis::indirect_iterator(contents->begin()), paludis::indirect_iterator(contents->end()), paludis::accept_visitor(finder));
-							}
-							found_owner = finder.isFound();
-							if(found_owner)
-							{
-//								std::cout << "File found : " << fileName << std::endl;
-								return found_owner;
-							}
-						}
-					}
-				}
-			}
-		}
-	}
-//	if(!found_owner)
-//		std::cout << "File not found : " << fileName << std::endl;
-	return found_owner;
+	CollisionStats & stats(collision_stats());
+	stats.stopPhase();
+	std::string statsFile(paludis::getenv_with_default("COLLISION_PROTECT_STATS", ""));
+	if(!statsFile.empty())
+		stats.write(statsFile, hook.get("CATEGORY") + "/" + hook.get("PN") + "-" + hook.get("PVR"));
 }
 
-void find_owner_worker(std::mutex & mutex, const paludis::Environment *& env, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, FSPathList::const_iterator & file, const FSPathList::const_iterator & file_end, FilesByPackage & collisions)
+/**
+ * Write the outcome of the check to ${COLLISION_PROTECT_JSON_REPORT} if set, on every exit,
+ * so that the file never describes an earlier package
+ * @param collisions Collisions found, empty when the package does not collide
+ * @param depSpec PackageDepSpec of the installing package, nullptr when the check is skipped, which removes the report
+ * @param truncated Whether fail-fast stopped the check before every collision was found
+ */
+void write_json(const FilesByPackage & collisions, const std::shared_ptr<const paludis::PackageDepSpec> & depSpec, bool truncated)
 {
-	try
-	{
-		while (true)
-		{
-			std::shared_ptr<const std::pair<std::string, bool>> currentFile;
-			{
-				std::unique_lock<std::mutex> lock(mutex);
-				if (file != file_end)
-					currentFile = std::make_shared<const std::pair<std::string, bool>>(*file++);
-			}
-
-			if (!currentFile)
-				return;
-			if(currentFile->second)
-			{
-				if(!find_owner(mutex, env, paludis::stringify(currentFile->first), &collisions))
-				{
-	/*
-	 * Add file to installing PackageID if orphaned
-	 */
-					bool pkgFound = false;
-					{
-						std::unique_lock<std::mutex> lock(mutex);
-						for(FilesByPackage::iterator fbpIt(collisions.begin()), fbpIt_end(collisions.end()); (fbpIt != fbpIt_end) && !pkgFound; ++fbpIt)
-						{
-							if(paludis::stringify(*(fbpIt->first)) == paludis::stringify(*depSpec))
-							{
-								pkgFound = true;
-								fbpIt->second.push_back(paludis::FSPath(currentFile->first));
-							}
-						}
-						if(!pkgFound)
-						{
-							std::vector<paludis::FSPath> fsPathVector;
-							fsPathVector.push_back(paludis::FSPath(currentFile->first));
-							collisions.insert(std::make_pair(depSpec, fsPathVector));
-						}
-					}
-				}
-	//			for(FilesByPackage::const_iterator fbpIt(collisions.begin()), fbpIt_end(collisions.end()); fbpIt != fbpIt_end; ++fbpIt)
-	//			{
-	//				std::cout << *(fbpIt->first) << std::endl;
-	//				for(std::vector<paludis::FSPath>::const_iterator fs(fbpIt->second.begin()), fs_end(fbpIt->second.end()); fs != fs_end; ++fs)
-	//					std::cout << *fs << std::endl;
-	//			}
-			}
-		}
-	}
-	catch (paludis::ConfigurationError &ex)
-	{
-	//	std::cout << "Error: " << ex.message() << std::endl;
-	//	std::cout << ex.backtrace("\n") << std::endl;
-	}
+	std::string jsonReportFile(paludis::getenv_with_default("COLLISION_PROTECT_JSON_REPORT", ""));
+	if(jsonReportFile.empty())
+		return;
+	if(!depSpec)
+		::unlink(jsonReportFile.c_str());
+	else if(!write_json_report(jsonReportFile, collisions, depSpec, truncated))
+		std::cout << "Cannot write JSON report to " << jsonReportFile << std::endl;
 }
 
 /**
@@ -339,6 +339,9 @@ void find_owner_worker(std::mutex & mutex, const paludis::Environment *& env, co
 paludis::HookResult paludis_hook_run_3(const paludis::Environment* env, const paludis::Hook& hook, const std::shared_ptr<paludis::OutputManager>& manager)
 {
     paludis::HookResult result = paludis::make_named_values<paludis::HookResult>(paludis::n::max_exit_status() = 0, paludis::n::output() = "");
+	CollisionStats & stats(collision_stats());
+	stats.reset();
+	stats.startPhase("config");
 /*
  * Showing all variables in hook
  * For debugging only
@@ -354,15 +357,17 @@ paludis::HookResult paludis_hook_run_3(const paludis::Environment* env, const pa
 	std::cout << std::endl;
 //	std::cout << "Checking contents of ${COLLISION_IGNORE}..." << std::endl;
 //	std::string collisionIgnore = paludis::getenv_with_default("COLLISION_IGNORE", "");
-	std::string collisionIgnore = get_envvar_from_bashrc(hook, "COLLISION_IGNORE");
+	std::string collisionIgnore, gccDataInfoDir;
+	resolve_config(hook, collisionIgnore, gccDataInfoDir);
 //	std::cout << "COLLISION_IGNORE : " << collisionIgnore << std::endl;
 	std::istringstream collIgnore_iss(collisionIgnore);
 	std::string root = hook.get("ROOT");
+	std::string canonicalRoot(canonicalize_path(root));
 	bool canIgnore = false;
 	std::string path;
 	while(collIgnore_iss >> path)
 	{
-		if(path == root)
+		if(canonicalize_path(path) == canonicalRoot)
 		{
 			canIgnore = true;
 			break;
@@ -374,24 +379,21 @@ paludis::HookResult paludis_hook_run_3(const paludis::Environment* env, const pa
 		message << "${COLLISION_IGNORE} contains \"" << root << "\", skipping collision check";
 		std::cout << message.str() << std::endl;
 		result.output() = message.str();
+		write_json(FilesByPackage(), nullptr, false);
+		write_stats(hook);
 		return result;
 	}
 	else
 	{
 //		std::cout << "Gathering directories in ${COLLISION_IGNORE}, ${CONFIG_PROTECT_MASK}, ${CONFIG_PROTECT} and info dirs..." << std::endl;
 		std::vector<std::string> collIgnoreVector;
-		fill_collision_ignore_with_variable(&collIgnoreVector, collisionIgnore);
-		fill_collision_ignore_with_variable(&collIgnoreVector, hook.get("CONFIG_PROTECT_MASK"));
-		fill_collision_ignore_with_variable(&collIgnoreVector, hook.get("CONFIG_PROTECT"));
-		fill_collision_ignore_with_variable(&collIgnoreVector, "/usr/share/info/dir");
-		std::string gccDataInfoDir = findGccDataInfoDir();
-		if(!gccDataInfoDir.empty())
-			fill_collision_ignore_with_variable(&collIgnoreVector, gccDataInfoDir + "/dir");
+		fill_collision_ignore(&collIgnoreVector, collisionIgnore, hook.get("CONFIG_PROTECT_MASK"), hook.get("CONFIG_PROTECT"), gccDataInfoDir);
 //		for(std::vector<std::string>::const_iterator cIVit(collIgnoreVector.begin()), cIVit_end(collIgnoreVector.end()); cIVit != cIVit_end; ++cIVit)
 //            std::cout << *cIVit << std::endl;
         ContentsList installedPkgFilesList;
  		FSPathList imageFileList;
 		FilesByPackage collisions;
+		PathResolver resolver;
 		paludis::QualifiedPackageName packageName(paludis::CategoryNamePart(hook.get("CATEGORY")), paludis::PackageNamePart(hook.get("PN")));
 		paludis::VersionSpec versionSpec(hook.get("PVR"), paludis::user_version_spec_options());
 		paludis::SlotName slot(hook.get("SLOT"));
@@ -402,19 +404,34 @@ paludis::HookResult paludis_hook_run_3(const paludis::Environment* env, const pa
 //		std::cout << "Destination repo: " << destination_repo << std::endl;
 		std::shared_ptr<const paludis::PackageID> packageID, oldPkgId;
 		std::shared_ptr<const paludis::PackageDepSpec> depSpec, oldDepSpec;
+/*
+ * Make packageID from CATEGORY, PN, PVR and SLOT
+ */
+//		std::cout << "Creating PackageDepSpec..." << std::endl;
+		depSpec = std::make_shared<const paludis::PackageDepSpec>(paludis::make_package_dep_spec({ }).package(packageName).version_requirement(paludis::make_named_values<paludis::VersionRequirement>(paludis::n::version_operator() = paludis::vo_equal, paludis::n::version_spec() = versionSpec)).slot_requirement(std::make_shared<paludis::ELikeSlotExactPartialRequirement>(slot, std::make_shared<paludis::ELikeSlotAnyAtAllLockedRequirement>())).in_repository(destination_repo));
 		std::cout << "Checking for collisions..." << std::endl;
 /*
  * Getting files from currently installing package
  */
 //		std::cout << "Iterating over ${IMAGE} directory..." << std::endl;
-		iterate_over_directory(paludis::FSPath(hook.get("IMAGE")), paludis::FSPath(hook.get("IMAGE")), &imageFileList, collIgnoreVector, root);
-//		for(FSPathList::const_iterator fs(imageFileList.begin()), fs_end(imageFileList.end()); fs != fs_end; ++fs)
-//			std::cout << fs->first << std::endl;
+		stats.startPhase("walk");
+		std::size_t existingFiles = iterate_over_directory(paludis::FSPath(hook.get("IMAGE")), &imageFileList, CollisionIgnore(collIgnoreVector), root);
+		stats.imageFiles = imageFileList.size();
 /*
- * Make packageID from CATEGORY, PN, PVR and SLOT
+ * Nothing to compare when no file of ${IMAGE} exists in ${ROOT}, which is the case of most new packages
  */
-//		std::cout << "Creating PackageDepSpec..." << std::endl;
-		depSpec = std::make_shared<const paludis::PackageDepSpec>(paludis::make_package_dep_spec({ }).package(packageName).version_requirement(paludis::make_named_values<paludis::VersionRequirement>(paludis::n::version_operator() = paludis::vo_equal, paludis::n::version_spec() = versionSpec)).slot_requirement(std::make_shared<paludis::ELikeSlotExactPartialRequirement>(slot, std::make_shared<paludis::ELikeSlotAnyAtAllLockedRequirement>())).in_repository(destination_repo));
+		if(existingFiles == 0)
+		{
+			std::string message("No collision detected, continuing");
+			std::cout << message << std::endl;
+			result.output() = message;
+			write_json(collisions, depSpec, false);
+			write_stats(hook);
+			return result;
+		}
+//		for(FSPathList::const_iterator fs(imageFileList.begin()), fs_end(imageFileList.end()); fs != fs_end; ++fs)
+//			std::cout << imageFileList.path(*fs) << std::endl;
+		stats.startPhase("old_contents");
 //		std::cout << "PkgDepSpec : " << *depSpec << std::endl;
 		std::shared_ptr<const paludis::PackageIDSequence> pkgIDs((*env)[paludis::selection::AllVersionsSorted(paludis::generator::Matches(*depSpec, nullptr, paludis::MatchPackageOptions()) |
 																				paludis::filter::And(
@@ -468,78 +485,110 @@ paludis::HookResult paludis_hook_run_3(const paludis::Environment* env, const pa
 		if(oldPkgId)
 		{
 //			std::cout << "OldPkgId : " << oldPkgId->canonical_form(paludis::idcf_full) << std::endl;
-			std::shared_ptr<const paludis::Contents> contents = oldPkgId->contents();
-			if (contents)
+			ContentsVisitorForIPFL visitor(hook.get("ROOT"), &installedPkgFilesList, &resolver);
+			ContentsReader reader;
+			std::shared_ptr<const paludis::Contents> contents;
+			if(reader.open(paludis::stringify(oldPkgId->fs_location_key()->parse_value())))
 			{
-				ContentsVisitorForIPFL visitor(hook.get("ROOT"), &installedPkgFilesList);
+				ContentsEntry entry;
+				while(reader.next(entry))
+					visitor.visit(entry);
+			}
+			else if((contents = oldPkgId->contents()))
 				std::for_each(
 					paludis::indirect_iterator(contents->begin()),
 					paludis::indirect_iterator(contents->end()),
 					paludis::accept_visitor(visitor)
 				);
-			}
+			++stats.packagesScanned;
 		}
 //		std::cout << "List of files already installed by other version of package..." << std::endl;
 //		for(ContentsList::const_iterator file(installedPkgFilesList.begin()), file_end(installedPkgFilesList.end()); file != file_end; file++)
-//		{
-//			std::cout << file->realpath_if_exists();
-//			if(file->stat().is_symlink())
-//				std::cout << " -> " << file->readlink();
-//			std::cout << std::endl;
-//		}
+//			std::cout << *file << std::endl;
 /*
  * If there are no files involved in collision in IMAGE, tell the user that everything is OK
  * Otherwise, find out packages containing files involved in collision
  */
-		if(compareFilesList(imageFileList, installedPkgFilesList))
+		stats.startPhase("compare");
+		std::size_t failFast(fail_fast_limit());
+		std::size_t limit(report_limit());
+		bool identicalCheck(identical_check());
+/*
+ * With the identical check, the fail-fast limit only applies to files found to differ
+ */
+		if(compareFilesList(imageFileList, installedPkgFilesList, resolver, identicalCheck ? 0 : failFast))
 		{
 			std::string message("No collision detected, continuing");
 			std::cout << message << std::endl;
 			result.output() = message;
+			write_json(collisions, depSpec, false);
+			write_stats(hook);
             return result;
 		}
 		else
 		{
-			std::cout << "Collisions detected, please wait..." << std::endl;
 /*
- * Find owners of existing files (this can take a while)
+ * Files byte-identical to the installed ones are benign duplicates, they need no owner search
  */
-			std::mutex mutex;
-//			std::cout << "(debug) Iterating... over ${IMAGE}" << std::endl;
-			FSPathList::const_iterator file(imageFileList.begin()), file_end(imageFileList.end());
+			std::vector<std::string> duplicates;
+			if(identicalCheck)
 			{
-				paludis::ThreadPool pool;
-				unsigned int n_procs(std::thread::hardware_concurrency());
-				if (n_procs == 0)
-					n_procs = 1;
-				for (int n(0), n_end(n_procs) ; n != n_end ; ++n)
+				stats.startPhase("identical");
+				std::size_t left = drop_identical_files(imageFileList, hook.get("IMAGE"), root, failFast, duplicates);
+				if(!duplicates.empty())
+				{
+					std::cout << duplicates.size() << " colliding files are identical to the installed ones, ignoring them:" << std::endl;
+					for(std::size_t n(0), n_end(std::min(limit, duplicates.size())); n != n_end; ++n)
+						std::cout << "\t" << duplicates[n] << std::endl;
+					if(duplicates.size() > limit)
+						std::cout << "\t... and " << duplicates.size() - limit << " more" << std::endl;
+				}
+				if(left == 0)
 				{
-//					std::cout << "(debug) Creating thread " << n << std::endl;
-					pool.create_thread(std::bind(&find_owner_worker, std::ref(mutex), std::ref(env), std::cref(depSpec), std::ref(file), std::cref(file_end), std::ref(collisions)));
+					std::string message("No collision detected besides identical files, continuing");
+					std::cout << message << std::endl;
+					result.output() = message;
+					write_json(collisions, depSpec, false);
+					write_stats(hook);
+					return result;
 				}
 			}
+			std::cout << "Collisions detected, please wait..." << std::endl;
 /*
- * Show each package and files involved in collision and abort installation
+ * Find owners of existing files (this can take a while)
  */
-			std::cout << "Detected collisions :" << std::endl;
-			for(FilesByPackage::const_iterator file(collisions.begin()), file_end(collisions.end()); file != file_end; ++file)
+			stats.startPhase("owners");
+			std::string socketFile(owner_socket_file());
+			if(socketFile.empty() || !find_owners_from_daemon(socketFile, env, root, depSpec, imageFileList, collisions))
 			{
-				if(paludis::stringify(*(file->first)) == paludis::stringify(*depSpec))
-					std::cout << "	Orphaned files :" << std::endl;
+				std::string indexFile(owner_index_file());
+				EnvironmentInstalledPackages installed(env);
+				if(!indexFile.empty())
+					find_owners_in_index(installed, indexFile, depSpec, imageFileList, collisions);
 				else
-					std::cout << "	" << *(file->first) << " :" << std::endl;
-				for(std::vector<paludis::FSPath>::const_iterator fs(file->second.begin()), fs_end(file->second.end()); fs != fs_end; ++fs)
-				{
-					std::cout << "		" << *fs;
-					if(fs->stat().is_symlink())
-						std::cout << " -> " << fs->readlink();
-					std::cout << std::endl;
-				}
+					find_owners(installed, depSpec, imageFileList, collisions);
+			}
+/*
+ * Show each package and files involved in collision and abort installation
+ */
+			stats.startPhase("report");
+			for(FilesByPackage::const_iterator c(collisions.begin()), c_end(collisions.end()); c != c_end; ++c)
+				stats.collisions += c->second.size();
+			print_collisions(std::cout, collisions, depSpec, limit);
+			std::string reportFile(report_file(hook));
+			if(stats.collisions > limit && !reportFile.empty())
+			{
+				::mkdir(collision_protect_cache_dir().c_str(), 0755);
+				if(write_collisions(reportFile, collisions, depSpec))
+					std::cout << "Complete list of collisions written to " << reportFile << std::endl;
 			}
-			std::string message("Collisions detected, aborting");
+			bool stoppedEarly(failFast != 0 && stats.collisions >= failFast);
+			write_json(collisions, depSpec, stoppedEarly);
+			std::string message(stoppedEarly ? "Collisions detected, stopped early and aborting" : "Collisions detected, aborting");
 			std::cout << message << std::endl;
 			result.max_exit_status() = 1;
 			result.output() = message;
+			write_stats(hook);
 			return result;
 		}
 	}
@@ -24,17 +24,30 @@
 #define __COLLISION_PROTECT_HH__
 
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <paludis/package_id.hh>
 
 #include <paludis/util/fs_path.hh>
 
+#include "FSPathList.hh"
+
 /**
  * Typedefs
  */
-typedef std::map<std::string, bool> FSPathList;
-typedef std::map<std::shared_ptr<const paludis::PackageDepSpec>, std::vector<paludis::FSPath> > FilesByPackage;
-typedef std::vector<paludis::FSPath> ContentsList;
+typedef std::unordered_map<std::string, std::vector<paludis::FSPath> > FilesByPackage;
+typedef std::unordered_set<std::string> ContentsList;
+
+/**
+ * Locations, shared with the tools
+ */
+std::string collision_protect_cache_dir();
+std::string owner_index_file();
+std::string owner_socket_file();
+std::string findGccDataInfoDir();
+void fill_collision_ignore_with_variable(std::vector<std::string> *, std::string);
+void fill_collision_ignore(std::vector<std::string> *, const std::string &, const std::string &, const std::string &, const std::string &);
 
 #endif // __COLLISION_PROTECT_HH__
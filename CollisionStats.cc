@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <sstream>
+
+#include "CollisionStats.hh"
+
+CollisionStats::CollisionStats()
+{
+	reset();
+}
+
+void CollisionStats::reset()
+{
+	imageFiles = 0;
+	collisions = 0;
+	statCalls = 0;
+	packagesScanned = 0;
+	contentsEntries = 0;
+	filteredPaths = 0;
+	identicalFiles = 0;
+	phases.clear();
+	phase.clear();
+}
+
+/**
+ * Start timing a phase, stopping the current one
+ * @param name Name of the phase
+ */
+void CollisionStats::startPhase(const std::string & name)
+{
+	stopPhase();
+	phase = name;
+	start = std::chrono::steady_clock::now();
+}
+
+void CollisionStats::stopPhase()
+{
+	if(phase.empty())
+		return;
+	phases.push_back(std::make_pair(phase, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()));
+	phase.clear();
+}
+
+/**
+ * Get the time spent in a phase
+ * @param name Name of the phase
+ * @return Elapsed time in milliseconds
+ */
+double CollisionStats::phaseTime(const std::string & name) const
+{
+	double time = 0;
+	for(std::vector<std::pair<std::string, double> >::const_iterator p(phases.begin()), p_end(phases.end()); p != p_end; ++p)
+		if(p->first == name)
+			time += p->second;
+	return time;
+}
+
+/**
+ * Append the statistics to a file, as one JSON object per line
+ * @param file File to append to
+ * @param package Package being checked
+ * @return whether the statistics were written
+ */
+bool CollisionStats::write(const std::string & file, const std::string & package) const
+{
+	std::ostringstream line;
+	line << "{\"package\":\"" << package << "\",\"phases\":{";
+	for(std::vector<std::pair<std::string, double> >::const_iterator p(phases.begin()), p_end(phases.end()); p != p_end; ++p)
+		line << (p == phases.begin() ? "" : ",") << "\"" << p->first << "\":" << p->second;
+	line << "},\"image_files\":" << imageFiles
+		<< ",\"collisions\":" << collisions
+		<< ",\"stat_calls\":" << statCalls
+		<< ",\"packages_scanned\":" << packagesScanned
+		<< ",\"contents_entries\":" << contentsEntries
+		<< ",\"filtered_paths\":" << filteredPaths
+		<< ",\"identical_files\":" << identicalFiles << "}\n";
+	std::ofstream out(file.c_str(), std::ios::app);
+	out << line.str();
+	return static_cast<bool>(out);
+}
+
+CollisionStats & collision_stats()
+{
+	static CollisionStats stats;
+	return stats;
+}
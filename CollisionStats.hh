@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COLLISION_STATS_HH__
+#define __COLLISION_STATS_HH__
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/**
+ * Elapsed time of each phase of the hook and counters of the work done
+ * Counters are updated by the workers, phases by the hook only.
+ */
+class CollisionStats
+{
+    public:
+        CollisionStats();
+        void reset();
+        void startPhase(const std::string &);
+        void stopPhase();
+        double phaseTime(const std::string &) const;
+        bool write(const std::string &, const std::string &) const;
+        std::atomic<unsigned long> imageFiles;
+        std::atomic<unsigned long> collisions;
+        std::atomic<unsigned long> statCalls;
+        std::atomic<unsigned long> packagesScanned;
+        std::atomic<unsigned long> contentsEntries;
+        std::atomic<unsigned long> filteredPaths;
+        std::atomic<unsigned long> identicalFiles;
+    private:
+        std::vector<std::pair<std::string, double> > phases;
+        std::string phase;
+        std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Statistics of the current hook invocation
+ */
+CollisionStats & collision_stats();
+
+#endif // __COLLISION_STATS_HH__
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ContentsReader.hh"
+
+ContentsReader::ContentsReader() :
+    format(vdb),
+    data(nullptr),
+    size(0),
+    pos(nullptr)
+{
+}
+
+ContentsReader::~ContentsReader()
+{
+	if(data && size != 0)
+		::munmap(const_cast<char *>(data), size);
+}
+
+/**
+ * Map the contents file of an installed package
+ * @param dir Directory of the package in the installed repository
+ * @return whether a contents file in a recognised format was mapped
+ */
+bool ContentsReader::open(const std::string & dir)
+{
+	const char * const names[] = { "contents", "CONTENTS" };
+	const Format formats[] = { exndbam, vdb };
+	for(int n(0); n != 2; ++n)
+	{
+		int fd = ::open((dir + "/" + names[n]).c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd == -1)
+			continue;
+		struct stat st;
+		if(::fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		format = formats[n];
+		size = st.st_size;
+		if(size == 0)
+		{
+			::close(fd);
+			data = "";
+			pos = data;
+			return true;
+		}
+		void * map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(map == MAP_FAILED)
+		{
+			size = 0;
+			return false;
+		}
+		::madvise(map, size, MADV_SEQUENTIAL);
+		data = static_cast<const char *>(map);
+		pos = data;
+/*
+ * Only trust the format when the first entry parses, paludis will deal with anything else
+ */
+		const char * first = data;
+		ContentsLine line;
+		ContentsEntry entry;
+		if(!scanner.next(first, data + size, line) || !parse(line, entry))
+		{
+			::munmap(map, size);
+			data = nullptr;
+			size = 0;
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Read the next entry, lines that can not be parsed are skipped
+ * @param entry Entry read
+ * @return false once the end of the file is reached
+ */
+bool ContentsReader::next(ContentsEntry & entry)
+{
+	ContentsLine line;
+	while(scanner.next(pos, data + size, line))
+		if(line.begin != line.end && parse(line, entry))
+			return true;
+	return false;
+}
+
+bool ContentsReader::parse(const ContentsLine & line, ContentsEntry & entry)
+{
+	return format == vdb ? parseVdb(line, entry) : parseExndbam(line, entry);
+}
+
+/**
+ * Parse a VDB line, "obj path md5 mtime", "sym path -> target mtime", "dir path", "fif path" or "dev path"
+ */
+bool ContentsReader::parseVdb(const ContentsLine & line, ContentsEntry & entry)
+{
+	const char * begin = line.begin;
+	const char * end = line.end;
+	if(line.firstSpace != begin + 3)
+		return false;
+	const char * path = line.firstSpace + 1;
+	const char * pathEnd = end;
+	if(std::memcmp(begin, "obj", 3) == 0)
+	{
+		entry.type = ContentsEntry::file;
+		if(!line.previousSpace || line.previousSpace == line.firstSpace)
+			return false;
+		pathEnd = line.previousSpace;
+	}
+	else if(std::memcmp(begin, "sym", 3) == 0)
+	{
+		entry.type = ContentsEntry::sym;
+		pathEnd = path;
+		while(pathEnd + 4 <= end && std::memcmp(pathEnd, " -> ", 4) != 0)
+			++pathEnd;
+		if(pathEnd + 4 > end)
+			return false;
+	}
+	else if(std::memcmp(begin, "dir", 3) == 0)
+		entry.type = ContentsEntry::dir;
+	else if(std::memcmp(begin, "fif", 3) == 0 || std::memcmp(begin, "dev", 3) == 0)
+		entry.type = ContentsEntry::other;
+	else
+		return false;
+	if(path == pathEnd)
+		return false;
+	entry.path = path;
+	entry.length = pathEnd - path;
+	return true;
+}
+
+/**
+ * Parse an exndbam line, "key=value" pairs separated by spaces, values escaped with backslashes
+ */
+bool ContentsReader::parseExndbam(const ContentsLine & line, ContentsEntry & entry)
+{
+	const char * begin = line.begin;
+	const char * end = line.end;
+	const char * type = nullptr;
+	std::size_t typeLength = 0;
+	bool hasPath = false;
+	const char * p = begin;
+	while(p < end)
+	{
+		const char * equal = static_cast<const char *>(std::memchr(p, '=', end - p));
+		if(!equal)
+			return false;
+		bool isType = equal - p == 4 && std::memcmp(p, "type", 4) == 0;
+		bool isPath = equal - p == 4 && std::memcmp(p, "path", 4) == 0;
+		const char * value = equal + 1;
+		bool escaped = false;
+		for(p = value; p < end && *p != ' '; ++p)
+			if(*p == '\\')
+			{
+				escaped = true;
+				++p;
+				if(p == end)
+					break;
+			}
+		const char * valueEnd = p < end ? p : end;
+		if(isType)
+		{
+			type = value;
+			typeLength = valueEnd - value;
+		}
+		else if(isPath)
+		{
+			hasPath = true;
+			if(!escaped)
+			{
+				entry.path = value;
+				entry.length = valueEnd - value;
+			}
+			else
+			{
+				unescaped.clear();
+				for(const char * c(value); c < valueEnd; ++c)
+				{
+					if(*c == '\\' && ++c < valueEnd)
+						unescaped.push_back(*c == 'n' ? '\n' : *c);
+					else if(*c != '\\')
+						unescaped.push_back(*c);
+				}
+				entry.path = unescaped.data();
+				entry.length = unescaped.size();
+			}
+		}
+		++p;
+	}
+	if(!type || !hasPath || entry.length == 0)
+		return false;
+	if(typeLength == 4 && std::memcmp(type, "file", 4) == 0)
+		entry.type = ContentsEntry::file;
+	else if(typeLength == 3 && std::memcmp(type, "sym", 3) == 0)
+		entry.type = ContentsEntry::sym;
+	else if(typeLength == 3 && std::memcmp(type, "dir", 3) == 0)
+		entry.type = ContentsEntry::dir;
+	else
+		entry.type = ContentsEntry::other;
+	return true;
+}
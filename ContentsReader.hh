@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONTENTS_READER_HH__
+#define __CONTENTS_READER_HH__
+
+#include <string>
+
+#include "ContentsScanner.hh"
+
+/**
+ * Entry of a contents file
+ * The path points into the mapped file, or into the reader when it had to be unescaped,
+ * and stays valid until the next entry is read.
+ */
+struct ContentsEntry
+{
+    enum Type { file, dir, sym, other };
+    Type type;
+    const char * path;
+    std::size_t length;
+};
+
+/**
+ * Reader of the contents file of an installed package, mapped in memory
+ * VDB "CONTENTS" and exndbam "contents" files are recognised. When open() fails
+ * the contents have to be read through paludis instead.
+ */
+class ContentsReader
+{
+    public:
+        ContentsReader();
+        ~ContentsReader();
+        bool open(const std::string &);
+        bool next(ContentsEntry &);
+    private:
+        enum Format { vdb, exndbam };
+        ContentsReader(const ContentsReader &);
+        ContentsReader & operator=(const ContentsReader &);
+        bool parse(const ContentsLine &, ContentsEntry &);
+        bool parseVdb(const ContentsLine &, ContentsEntry &);
+        bool parseExndbam(const ContentsLine &, ContentsEntry &);
+        ContentsScanner scanner;
+        Format format;
+        const char * data;
+        std::size_t size;
+        const char * pos;
+        std::string unescaped;
+};
+
+#endif // __CONTENTS_READER_HH__
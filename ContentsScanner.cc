@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CONTENTS_SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+#include "ContentsScanner.hh"
+
+namespace
+{
+	void scan_scalar(const char * begin, const char * end, ContentsLine & line)
+	{
+		const char * p = begin;
+		for( ; p != end && *p != '\n'; ++p)
+			if(*p == ' ')
+			{
+				if(!line.firstSpace)
+					line.firstSpace = p;
+				line.previousSpace = line.lastSpace;
+				line.lastSpace = p;
+			}
+		line.end = p;
+	}
+
+#ifdef CONTENTS_SCANNER_X86
+	/**
+	 * Record the spaces of a block
+	 * @param block First byte of the block
+	 * @param spaces Bit n set when byte n of the block is a space
+	 */
+	inline void add_spaces(const char * block, uint32_t spaces, ContentsLine & line)
+	{
+		if(!spaces)
+			return;
+		if(!line.firstSpace)
+			line.firstSpace = block + __builtin_ctz(spaces);
+		int last = 31 - __builtin_clz(spaces);
+		spaces &= ~(uint32_t(1) << last);
+		line.previousSpace = spaces ? block + (31 - __builtin_clz(spaces)) : line.lastSpace;
+		line.lastSpace = block + last;
+	}
+
+	void scan_sse2(const char * begin, const char * end, ContentsLine & line)
+	{
+		const __m128i newline = _mm_set1_epi8('\n');
+		const __m128i space = _mm_set1_epi8(' ');
+		const char * p = begin;
+		for( ; end - p >= 16; p += 16)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+			uint32_t newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+			uint32_t spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(block, space));
+			if(newlines)
+			{
+				int n = __builtin_ctz(newlines);
+				add_spaces(p, spaces & ((uint32_t(1) << n) - 1), line);
+				line.end = p + n;
+				return;
+			}
+			add_spaces(p, spaces, line);
+		}
+		scan_scalar(p, end, line);
+	}
+
+	__attribute__((target("avx2")))
+	void scan_avx2(const char * begin, const char * end, ContentsLine & line)
+	{
+		const __m256i newline = _mm256_set1_epi8('\n');
+		const __m256i space = _mm256_set1_epi8(' ');
+		const char * p = begin;
+		for( ; end - p >= 32; p += 32)
+		{
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+			uint32_t newlines = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+			uint32_t spaces = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, space));
+			if(newlines)
+			{
+				int n = __builtin_ctz(newlines);
+				add_spaces(p, n == 0 ? 0 : spaces & (~uint32_t(0) >> (32 - n)), line);
+				line.end = p + n;
+				return;
+			}
+			add_spaces(p, spaces, line);
+		}
+		scan_sse2(p, end, line);
+	}
+#endif
+}
+
+ContentsScanner::ContentsScanner()
+{
+	static const Implementation implementation(best());
+	*this = ContentsScanner(implementation);
+}
+
+ContentsScanner::ContentsScanner(Implementation implementation) :
+    scan(&scan_scalar)
+{
+#ifdef CONTENTS_SCANNER_X86
+	if(implementation == avx2 && supported(avx2))
+		scan = &scan_avx2;
+	else if(implementation != scalar)
+		scan = &scan_sse2;
+#endif
+}
+
+/**
+ * @return Fastest implementation the CPU supports
+ */
+ContentsScanner::Implementation ContentsScanner::best()
+{
+	return supported(avx2) ? avx2 : supported(sse2) ? sse2 : scalar;
+}
+
+bool ContentsScanner::supported(Implementation implementation)
+{
+#ifdef CONTENTS_SCANNER_X86
+	if(implementation == avx2)
+	{
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}
+	return true;
+#else
+	return implementation == scalar;
+#endif
+}
+
+const char * ContentsScanner::name(Implementation implementation)
+{
+	switch(implementation)
+	{
+		case sse2:
+			return "sse2";
+		case avx2:
+			return "avx2";
+		default:
+			return "scalar";
+	}
+}
+
+/**
+ * Split the next line
+ * @param pos Start of the line, moved past its end
+ * @param end End of the buffer
+ * @param line Boundaries of the line
+ * @return false once the end of the buffer is reached
+ */
+bool ContentsScanner::next(const char * & pos, const char * end, ContentsLine & line) const
+{
+	if(pos >= end)
+		return false;
+	line.begin = pos;
+	line.firstSpace = nullptr;
+	line.lastSpace = nullptr;
+	line.previousSpace = nullptr;
+	scan(pos, end, line);
+	pos = line.end + 1;
+	return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONTENTS_SCANNER_HH__
+#define __CONTENTS_SCANNER_HH__
+
+#include <string>
+
+/**
+ * Field boundaries of a contents line
+ * Spaces are the ones found before the end of the line, null when there are not enough.
+ */
+struct ContentsLine
+{
+    const char * begin;
+    const char * end;
+    const char * firstSpace;
+    const char * lastSpace;
+    const char * previousSpace;
+};
+
+/**
+ * Scanner splitting contents files into lines and fields
+ * Newlines and spaces are searched many bytes at a time, with SSE2 or AVX2 when the CPU has them.
+ */
+class ContentsScanner
+{
+    public:
+        enum Implementation { scalar, sse2, avx2 };
+        ContentsScanner();
+        ContentsScanner(Implementation);
+        static Implementation best();
+        static bool supported(Implementation);
+        static const char * name(Implementation);
+        bool next(const char * &, const char *, ContentsLine &) const;
+    private:
+        void (* scan)(const char *, const char *, ContentsLine &);
+};
+
+#endif // __CONTENTS_SCANNER_HH__
@@ -22,17 +22,20 @@
 
 #include <paludis/util/stringify.hh>
 
+#include "CollisionStats.hh"
 #include "ContentsVisitorForIPFL.hh"
 
-ContentsVisitorForIPFL::ContentsVisitorForIPFL(std::string root, ContentsList* ipfl)
+ContentsVisitorForIPFL::ContentsVisitorForIPFL(std::string root, ContentsList* ipfl, PathResolver* resolver)
 {
     this->root = root;
     this->ipfl = ipfl;
+    this->resolver = resolver;
 }
 
 void ContentsVisitorForIPFL::visit(const paludis::ContentsFileEntry & d)
 {
-	this->ipfl->push_back(d.location_key()->parse_value().realpath_if_exists());
+	++collision_stats().contentsEntries;
+	this->ipfl->insert(this->resolver->resolve(paludis::stringify(d.location_key()->parse_value())));
 }
 
 void ContentsVisitorForIPFL::visit(const paludis::ContentsDirEntry & d)
@@ -43,5 +46,14 @@ void ContentsVisitorForIPFL::visit(const paludis::ContentsOtherEntry & d)
 
 void ContentsVisitorForIPFL::visit(const paludis::ContentsSymEntry & d)
 {
-	this->ipfl->push_back(d.location_key()->parse_value().realpath_if_exists());
+	++collision_stats().contentsEntries;
+	this->ipfl->insert(this->resolver->resolve(paludis::stringify(d.location_key()->parse_value())));
+}
+
+void ContentsVisitorForIPFL::visit(const ContentsEntry & d)
+{
+	if(d.type != ContentsEntry::file && d.type != ContentsEntry::sym)
+		return;
+	++collision_stats().contentsEntries;
+	this->ipfl->insert(this->resolver->resolve(std::string(d.path, d.length)));
 }
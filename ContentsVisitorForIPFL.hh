@@ -27,12 +27,14 @@
 #include <paludis/metadata_key.hh>
 
 #include "CollisionProtect.hh"
+#include "ContentsReader.hh"
+#include "PathResolver.hh"
 
 class ContentsVisitorForIPFL
 {
     public:
 //        ContentsVisitorForIPFL(std::string, std::vector<FSDescriptor>*);
-        ContentsVisitorForIPFL(std::string, ContentsList*);
+        ContentsVisitorForIPFL(std::string, ContentsList*, PathResolver*);
 //        void visit(const paludis::ContentsDevEntry & d);
 //        void visit(const paludis::ContentsMiscEntry & d);
         void visit(const paludis::ContentsFileEntry & d);
@@ -40,10 +42,12 @@ class ContentsVisitorForIPFL
 //        void visit(const paludis::ContentsFifoEntry & d);
         void visit(const paludis::ContentsOtherEntry & d);
         void visit(const paludis::ContentsSymEntry & d);
+        void visit(const ContentsEntry & d);
     private:
         std::string root;
 //        std::vector<FSDescriptor>* ipfl;
         ContentsList* ipfl;
+        PathResolver* resolver;
 };
 
 #endif // __CONTENTS_VISITOR_FOR_IPFL_HH__
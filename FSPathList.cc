@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "FSPathList.hh"
+
+/**
+ * Add a file, the list has to be sorted again afterwards
+ * @param path Path of the file
+ * @param collides Whether the file collides
+ */
+void FSPathList::add(const std::string & path, bool collides)
+{
+	Record record;
+	record.offset = arena.size();
+	record.length = path.size();
+	record.collides = collides;
+	arena.insert(arena.end(), path.begin(), path.end());
+	arena.push_back('\0');
+	records.push_back(record);
+}
+
+/**
+ * Add all files of another list, the list has to be sorted again afterwards
+ * @param other List to add
+ */
+void FSPathList::append(const FSPathList & other)
+{
+	std::size_t base = arena.size();
+	arena.insert(arena.end(), other.arena.begin(), other.arena.end());
+	records.reserve(records.size() + other.records.size());
+	for(const_iterator r(other.records.begin()), r_end(other.records.end()); r != r_end; ++r)
+	{
+		records.push_back(*r);
+		records.back().offset += base;
+	}
+}
+
+/**
+ * Order the files by path, as std::string would
+ */
+void FSPathList::sort()
+{
+	const char * base = arena.empty() ? nullptr : &arena[0];
+	std::sort(records.begin(), records.end(), [base] (const Record & a, const Record & b)
+	{
+		int cmp = std::memcmp(base + a.offset, base + b.offset, std::min(a.length, b.length));
+		return cmp < 0 || (cmp == 0 && a.length < b.length);
+	});
+}
+
+/**
+ * @param record Record of the list
+ * @return NUL-terminated path, valid until the next file is added
+ */
+const char * FSPathList::path(const Record & record) const
+{
+	return &arena[record.offset];
+}
+
+std::string FSPathList::pathString(const Record & record) const
+{
+	return std::string(&arena[record.offset], record.length);
+}
+
+std::size_t FSPathList::size() const
+{
+	return records.size();
+}
+
+bool FSPathList::empty() const
+{
+	return records.empty();
+}
+
+FSPathList::iterator FSPathList::begin()
+{
+	return records.begin();
+}
+
+FSPathList::iterator FSPathList::end()
+{
+	return records.end();
+}
+
+FSPathList::const_iterator FSPathList::begin() const
+{
+	return records.begin();
+}
+
+FSPathList::const_iterator FSPathList::end() const
+{
+	return records.end();
+}
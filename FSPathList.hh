@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FS_PATH_LIST_HH__
+#define __FS_PATH_LIST_HH__
+
+#include <string>
+#include <vector>
+
+/**
+ * Files of ${IMAGE}, sorted by path
+ * Paths are stored one after the other in a single arena, each NUL-terminated,
+ * records only keep where their path lies and whether it collides.
+ */
+class FSPathList
+{
+    public:
+        struct Record
+        {
+            std::size_t offset;
+            std::size_t length;
+            bool collides;
+        };
+        typedef std::vector<Record>::iterator iterator;
+        typedef std::vector<Record>::const_iterator const_iterator;
+        void add(const std::string &, bool);
+        void append(const FSPathList &);
+        void sort();
+        const char * path(const Record &) const;
+        std::string pathString(const Record &) const;
+        std::size_t size() const;
+        bool empty() const;
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+    private:
+        std::vector<char> arena;
+        std::vector<Record> records;
+};
+
+#endif // __FS_PATH_LIST_HH__
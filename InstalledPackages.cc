@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+
+#include <paludis/paludis.hh>
+
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#include "ContentsReader.hh"
+#include "InstalledPackages.hh"
+
+namespace
+{
+	class ContentsCallbackVisitor
+	{
+		public:
+			ContentsCallbackVisitor(const ContentsCallback & callback) : callback(callback) { }
+			void visit(const paludis::ContentsFileEntry & e) { forward(e.location_key()->parse_value()); }
+			void visit(const paludis::ContentsDirEntry &) { }
+			void visit(const paludis::ContentsOtherEntry &) { }
+			void visit(const paludis::ContentsSymEntry & e) { forward(e.location_key()->parse_value()); }
+		private:
+			void forward(const paludis::FSPath & location)
+			{
+				std::string path(paludis::stringify(location));
+				callback(path.data(), path.size());
+			}
+			const ContentsCallback & callback;
+	};
+
+	/**
+	 * Build a stamp identifying the state of the contents file of an installed PackageID
+	 * @param pkgID Installed PackageID
+	 * @return Stamp, empty if the package has no contents file
+	 */
+	std::string contents_stamp(const std::shared_ptr<const paludis::PackageID> & pkgID)
+	{
+		paludis::FSPath vdb_dir(pkgID->fs_location_key()->parse_value());
+		const char * const names[] = { "contents", "CONTENTS" };
+		for(const char * name : names)
+		{
+			struct stat st;
+			if(::stat(paludis::stringify(vdb_dir / name).c_str(), &st) == 0)
+			{
+				std::ostringstream stamp;
+				stamp << st.st_ino << ":" << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+				return stamp.str();
+			}
+		}
+		return "";
+	}
+}
+
+InstalledPackages::~InstalledPackages()
+{
+}
+
+EnvironmentInstalledPackages::EnvironmentInstalledPackages(const paludis::Environment * env)
+{
+	for(paludis::EnvironmentImplementation::RepositoryConstIterator r(env->begin_repositories()), r_end(env->end_repositories()); r != r_end; ++r)
+	{
+		if((*r)->installed_root_key())
+		{
+			std::shared_ptr<const paludis::CategoryNamePartSet> cats((*r)->category_names({}));
+			for(paludis::CategoryNamePartSet::ConstIterator c(cats->begin()), c_end(cats->end()); c != c_end; ++c)
+			{
+				std::shared_ptr<const paludis::QualifiedPackageNameSet> pkgs((*r)->package_names(*c, {}));
+				for(paludis::QualifiedPackageNameSet::ConstIterator p(pkgs->begin()), p_end(pkgs->end()); p != p_end; ++p)
+				{
+					std::shared_ptr<const paludis::PackageIDSequence> ids((*r)->package_ids(*p, {}));
+					for(paludis::PackageIDSequence::ConstIterator v(ids->begin()), v_end(ids->end()); v != v_end; ++v)
+					{
+						std::string stamp(contents_stamp(*v));
+						if(!stamp.empty())
+						{
+							this->ids.push_back(*v);
+							this->stamps.push_back(stamp);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+std::size_t EnvironmentInstalledPackages::size() const
+{
+	return ids.size();
+}
+
+std::shared_ptr<const paludis::PackageDepSpec> EnvironmentInstalledPackages::depSpec(std::size_t n) const
+{
+	return std::make_shared<const paludis::PackageDepSpec>(ids[n]->uniquely_identifying_spec());
+}
+
+std::string EnvironmentInstalledPackages::stamp(std::size_t n) const
+{
+	return stamps[n];
+}
+
+/**
+ * Visit files and symlinks of an installed package
+ * The contents file is read directly when its format is known, through paludis otherwise
+ * @param n Package index
+ * @param callback Called with each path
+ */
+void EnvironmentInstalledPackages::visitContents(std::size_t n, const ContentsCallback & callback) const
+{
+	ContentsReader reader;
+	if(reader.open(paludis::stringify(ids[n]->fs_location_key()->parse_value())))
+	{
+		ContentsEntry entry;
+		while(reader.next(entry))
+			if(entry.type == ContentsEntry::file || entry.type == ContentsEntry::sym)
+				callback(entry.path, entry.length);
+		return;
+	}
+	std::shared_ptr<const paludis::Contents> contents(ids[n]->contents());
+	if(contents)
+	{
+		ContentsCallbackVisitor visitor(callback);
+		std::for_each(paludis::indirect_iterator(contents->begin()), paludis::indirect_iterator(contents->end()), paludis::accept_visitor(visitor));
+	}
+}
+
+/**
+ * Describe the installed repositories of an Environment
+ * @param env Environment
+ * @return Name, location and root of each installed repository, in repository order
+ */
+std::string installed_repositories(const paludis::Environment * env)
+{
+	std::ostringstream description;
+	for(paludis::EnvironmentImplementation::RepositoryConstIterator r(env->begin_repositories()), r_end(env->end_repositories()); r != r_end; ++r)
+	{
+		if((*r)->installed_root_key())
+		{
+			description << (*r)->name() << ":";
+			if((*r)->location_key())
+				description << (*r)->location_key()->parse_value();
+			description << ":" << (*r)->installed_root_key()->parse_value() << " ";
+		}
+	}
+	return description.str();
+}
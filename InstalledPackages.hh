@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __INSTALLED_PACKAGES_HH__
+#define __INSTALLED_PACKAGES_HH__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <paludis/environment.hh>
+#include <paludis/package_id.hh>
+
+#include <paludis/util/fs_path.hh>
+
+/**
+ * Called with each file and symlink of a package, the path is not NUL-terminated
+ */
+typedef std::function<void (const char *, std::size_t)> ContentsCallback;
+
+/**
+ * Installed packages searched for owners of colliding files
+ * Packages are numbered from 0 in repository order.
+ */
+class InstalledPackages
+{
+    public:
+        virtual ~InstalledPackages();
+        virtual std::size_t size() const = 0;
+        virtual std::shared_ptr<const paludis::PackageDepSpec> depSpec(std::size_t) const = 0;
+        virtual std::string stamp(std::size_t) const = 0;
+        virtual void visitContents(std::size_t, const ContentsCallback &) const = 0;
+};
+
+/**
+ * Installed packages of the repositories of an Environment having a contents file
+ */
+class EnvironmentInstalledPackages : public InstalledPackages
+{
+    public:
+        EnvironmentInstalledPackages(const paludis::Environment *);
+        std::size_t size() const;
+        std::shared_ptr<const paludis::PackageDepSpec> depSpec(std::size_t) const;
+        std::string stamp(std::size_t) const;
+        void visitContents(std::size_t, const ContentsCallback &) const;
+    private:
+        std::vector<std::shared_ptr<const paludis::PackageID> > ids;
+        std::vector<std::string> stamps;
+};
+
+/**
+ * Describe the installed repositories of an Environment, to tell environments apart
+ */
+std::string installed_repositories(const paludis::Environment *);
+
+#endif // __INSTALLED_PACKAGES_HH__
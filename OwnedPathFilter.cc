@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "OwnedPathFilter.hh"
+
+namespace
+{
+	const std::string filter_magic("collisionprotect-filter 2");
+
+	/**
+	 * Hash a path twice, the bits of the filter being derived from both hashes
+	 */
+	void hash_path(const std::string & path, uint64_t & h1, uint64_t & h2)
+	{
+		uint64_t h = 14695981039346656037ULL;
+		for(std::string::const_iterator c(path.begin()), c_end(path.end()); c != c_end; ++c)
+		{
+			h ^= static_cast<unsigned char>(*c);
+			h *= 1099511628211ULL;
+		}
+		h1 = h;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		h2 = h | 1;
+	}
+}
+
+OwnedPathFilter::OwnedPathFilter() :
+    hashes(0),
+    capacity(0),
+    count(0)
+{
+}
+
+/**
+ * Empty the filter and size it for a number of paths
+ * Ten bits per path and seven hashes keep false positives around 1%
+ * @param paths Expected number of paths
+ */
+void OwnedPathFilter::reset(std::size_t paths)
+{
+	bits.assign(paths / 6 + 1, 0);
+	hashes = 7;
+	capacity = paths;
+	count = 0;
+}
+
+void OwnedPathFilter::add(const std::string & path)
+{
+	uint64_t h1, h2;
+	hash_path(path, h1, h2);
+	uint64_t size = bits.size() * 64;
+	for(unsigned int n(0); n != hashes; ++n)
+	{
+		uint64_t bit = (h1 + n * h2) % size;
+		bits[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+	++count;
+}
+
+bool OwnedPathFilter::empty() const
+{
+	return hashes == 0;
+}
+
+/**
+ * Check whether too many paths were added for the size of the filter
+ * False positives then grow past 4%
+ */
+bool OwnedPathFilter::saturated() const
+{
+	return count > capacity + capacity / 2;
+}
+
+/**
+ * Check whether a path may be owned
+ * @param path Path to check
+ * @return false if the path is owned by no package, true if it may be
+ */
+bool OwnedPathFilter::mayContain(const std::string & path) const
+{
+	if(hashes == 0)
+		return true;
+	uint64_t h1, h2;
+	hash_path(path, h1, h2);
+	uint64_t size = bits.size() * 64;
+	for(unsigned int n(0); n != hashes; ++n)
+	{
+		uint64_t bit = (h1 + n * h2) % size;
+		if(!(bits[bit / 64] & (uint64_t(1) << (bit % 64))))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Read the filter from disk
+ * @param file Filter file
+ * @param generation Generation of the index the filter must belong to
+ * @return whether a matching filter was read, the filter being left empty otherwise
+ */
+bool OwnedPathFilter::load(const std::string & file, const std::string & generation)
+{
+	bits.clear();
+	hashes = 0;
+	std::ifstream in(file.c_str(), std::ios::binary);
+	std::string line, fileGeneration;
+	std::size_t words = 0, fileCapacity = 0, fileCount = 0;
+	unsigned int fileHashes = 0;
+	if(!getline(in, line) || line != filter_magic)
+		return false;
+	if(!getline(in, line) || !(std::istringstream(line) >> fileGeneration >> words >> fileHashes >> fileCapacity >> fileCount) || fileGeneration != generation || words == 0)
+		return false;
+	bits.resize(words);
+	if(!in.read(reinterpret_cast<char *>(&bits[0]), words * sizeof(uint64_t)))
+	{
+		bits.clear();
+		return false;
+	}
+	hashes = fileHashes;
+	capacity = fileCapacity;
+	count = fileCount;
+	return true;
+}
+
+/**
+ * Write the filter to disk, through a temporary file renamed over the old one
+ * @param file Filter file
+ * @param generation Generation of the index the filter belongs to
+ * @return whether the filter was written
+ */
+bool OwnedPathFilter::save(const std::string & file, const std::string & generation) const
+{
+	if(hashes == 0)
+		return false;
+	std::ostringstream tmpFile;
+	tmpFile << file << ".tmp." << ::getpid();
+	std::ofstream out(tmpFile.str().c_str(), std::ios::binary);
+	out << filter_magic << "\n" << generation << " " << bits.size() << " " << hashes << " " << capacity << " " << count << "\n";
+	out.write(reinterpret_cast<const char *>(&bits[0]), bits.size() * sizeof(uint64_t));
+	out.close();
+	if(!out || ::rename(tmpFile.str().c_str(), file.c_str()) != 0)
+	{
+		::unlink(tmpFile.str().c_str());
+		return false;
+	}
+	return true;
+}
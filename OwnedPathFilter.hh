@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OWNED_PATH_FILTER_HH__
+#define __OWNED_PATH_FILTER_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Bloom filter of every installed path
+ * A path it does not contain is owned by no package. An empty filter contains everything.
+ * Paths can only be added, the filter is saturated once half as many paths again as
+ * it was sized for were added, and should then be rebuilt.
+ */
+class OwnedPathFilter
+{
+    public:
+        OwnedPathFilter();
+        void reset(std::size_t);
+        void add(const std::string &);
+        bool empty() const;
+        bool saturated() const;
+        bool mayContain(const std::string &) const;
+        bool load(const std::string &, const std::string &);
+        bool save(const std::string &, const std::string &) const;
+    private:
+        std::vector<uint64_t> bits;
+        unsigned int hashes;
+        std::size_t capacity;
+        std::size_t count;
+};
+
+#endif // __OWNED_PATH_FILTER_HH__
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "CanonicalPath.hh"
+#include "OwnerClient.hh"
+
+const char * const owner_protocol_magic = "collisionprotect-owners 2";
+
+/**
+ * Read from a descriptor until end of file
+ * @param fd Descriptor to read
+ * @param data Data read
+ * @return whether end of file was reached without error
+ */
+bool read_all(int fd, std::string & data)
+{
+	char buffer[65536];
+	while(true)
+	{
+		ssize_t n = ::read(fd, buffer, sizeof(buffer));
+		if(n == 0)
+			return true;
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		data.append(buffer, n);
+	}
+}
+
+/**
+ * Write all data to a descriptor
+ * @param fd Descriptor to write
+ * @param data Data to write
+ * @return whether everything was written
+ */
+bool write_all(int fd, const std::string & data)
+{
+	std::size_t done = 0;
+	while(done != data.size())
+	{
+		ssize_t n = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+OwnerClient::OwnerClient(std::string socketFile)
+{
+    this->socketFile = socketFile;
+}
+
+/**
+ * Ask the daemon for the owners of paths
+ * @param root ${ROOT} the paths belong to
+ * @param repositories Installed repositories the owners are searched in, from installed_repositories()
+ * @param paths Paths to look up
+ * @param owners Owner of each path, as its stringified PackageDepSpec, empty when not owned
+ * @return whether the daemon answered, owners is left alone otherwise
+ */
+bool OwnerClient::query(const std::string & root, const std::string & repositories, const std::vector<std::string> & paths, std::vector<std::string> & owners) const
+{
+	struct sockaddr_un address;
+	if(socketFile.size() >= sizeof(address.sun_path))
+		return false;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, socketFile.c_str());
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd == -1)
+		return false;
+/*
+ * The daemon refreshes its index before answering, give it time to read a few merged packages
+ */
+	struct timeval timeout;
+	timeout.tv_sec = 60;
+	timeout.tv_usec = 0;
+	::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	std::ostringstream request;
+	request << owner_protocol_magic << "\n" << canonicalize_path(root) << "\n" << repositories << "\n" << paths.size() << "\n";
+	for(std::vector<std::string>::const_iterator p(paths.begin()), p_end(paths.end()); p != p_end; ++p)
+		request << *p << "\n";
+	std::string answer;
+	bool ok = ::connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0
+		&& write_all(fd, request.str())
+		&& ::shutdown(fd, SHUT_WR) == 0
+		&& read_all(fd, answer);
+	::close(fd);
+	if(!ok)
+		return false;
+	std::istringstream in(answer);
+	std::string line;
+	if(!getline(in, line) || line != "ok")
+		return false;
+	std::vector<std::string> result;
+	result.reserve(paths.size());
+	while(result.size() != paths.size() && getline(in, line))
+		result.push_back(line == "-" ? std::string() : line);
+	if(result.size() != paths.size())
+		return false;
+	owners.swap(result);
+	return true;
+}
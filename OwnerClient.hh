@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OWNER_CLIENT_HH__
+#define __OWNER_CLIENT_HH__
+
+#include <string>
+#include <vector>
+
+/**
+ * Protocol spoken over the Unix socket of collision_owner_daemon
+ * A query is the magic line, ${ROOT}, the installed repositories as described by
+ * installed_repositories(), the number of paths and one path per line, the client then
+ * shuts its side down. The answer is "ok" and one line per path holding its owner,
+ * or "-" when nobody owns it, or "error" and a message, which is also the answer
+ * of a daemon serving another ${ROOT} or other repositories.
+ */
+extern const char * const owner_protocol_magic;
+
+bool read_all(int, std::string &);
+bool write_all(int, const std::string &);
+
+/**
+ * Client asking collision_owner_daemon for the owners of paths
+ */
+class OwnerClient
+{
+    public:
+        OwnerClient(std::string);
+        bool query(const std::string &, const std::string &, const std::vector<std::string> &, std::vector<std::string> &) const;
+    private:
+        std::string socketFile;
+};
+
+#endif // __OWNER_CLIENT_HH__
@@ -21,62 +21,81 @@
  */
 
 #include <iostream>
+#include <limits>
 #include <paludis/util/stringify.hh>
 
+#include "CanonicalPath.hh"
 #include "OwnerFinder.hh"
 
-OwnerFinder::OwnerFinder(std::string fileToFind, std::shared_ptr<const paludis::PackageDepSpec> & depSpec, FilesByPackage * collisions)
+OwnerSearch::OwnerSearch(const FSPathList & imageList, std::size_t packages) :
+    unresolved(0),
+    bound(packages)
 {
-    this->fileToFind = fileToFind;
-    this->depSpec = depSpec;
-    this->collisions = collisions;
-    this->found = false;
-}
-
-void OwnerFinder::find(const paludis::FSPath & fsPath)
-{
-	if(this->fileToFind == paludis::stringify(fsPath))
+	for(FSPathList::const_iterator file(imageList.begin()), file_end(imageList.end()); file != file_end; ++file)
 	{
-		bool pkgFound = false;
-		this->found = true;
-		for(FilesByPackage::iterator fbpIt(this->collisions->begin()), fbpIt_end(this->collisions->end()); fbpIt != fbpIt_end && !pkgFound; ++fbpIt)
-		{
-			if(paludis::stringify(*(fbpIt->first)) == paludis::stringify(*(this->depSpec)))
-			{
-				pkgFound = true;
-				fbpIt->second.push_back(fsPath);
-			}
-		}
-		if(!pkgFound)
+		if(file->collides)
 		{
-			std::vector<paludis::FSPath> fsPathVector;
-			fsPathVector.push_back(fsPath);
-			this->collisions->insert(std::make_pair(this->depSpec, fsPathVector));
+			slots.insert(std::make_pair(imageList.pathString(*file), paths.size()));
+			paths.push_back(imageList.pathString(*file));
 		}
 	}
+	best.reset(new std::atomic<std::size_t>[paths.size()]);
+	for(std::size_t n(0), n_end(paths.size()); n != n_end; ++n)
+		best[n] = std::numeric_limits<std::size_t>::max();
+	owned.reset(new std::atomic<std::size_t>[packages]);
+	for(std::size_t n(0); n != packages; ++n)
+		owned[n] = 0;
+	unresolved = paths.size();
 }
 
-bool OwnerFinder::isFound() const
-{
-	return found;
-}
-
-void OwnerFinder::visit(const paludis::ContentsFileEntry & e)
-{
-	paludis::FSPath fsPath(e.location_key()->parse_value());
-	this->find(fsPath);
-}
-
-void OwnerFinder::visit(const paludis::ContentsDirEntry & e)
+/**
+ * Check whether a package can no longer own any colliding file, as the first in repository order
+ * Best owners only go down, so the last package being one is searched down from the previous one
+ * @param package Package index
+ * @return whether every colliding file already has an owner before the package
+ */
+bool OwnerSearch::settled(std::size_t package) const
 {
+	if(unresolved != 0)
+		return false;
+	std::size_t last = bound;
+	while(last != 0 && owned[last - 1] == 0)
+		--last;
+	std::size_t current = bound;
+	while(last < current && !bound.compare_exchange_weak(current, last))
+		;
+	return last <= package;
 }
 
-void OwnerFinder::visit(const paludis::ContentsOtherEntry & e)
+OwnerFinder::OwnerFinder(OwnerSearch & search, std::size_t package, OwnerHits * hits) :
+    search(search)
 {
+    this->package = package;
+    this->hits = hits;
 }
 
-void OwnerFinder::visit(const paludis::ContentsSymEntry & e)
+void OwnerFinder::find(const char * path, std::size_t length)
 {
-	paludis::FSPath fsPath(e.location_key()->parse_value());
-	this->find(fsPath);
+	this->key.resize(length + 1);
+	this->key.resize(canonicalize_path(path, length, &this->key[0]));
+	std::unordered_map<std::string, std::size_t>::const_iterator slot(this->search.slots.find(this->key));
+	if(slot != this->search.slots.end())
+	{
+		this->hits->push_back(std::make_pair(slot->second, this->package));
+		std::atomic<std::size_t> & best(this->search.best[slot->second]);
+		std::size_t current = best;
+		while(this->package < current && !best.compare_exchange_weak(current, this->package))
+			;
+		if(this->package < current)
+		{
+/*
+ * Count the file for its new owner before uncounting it, so that settled() never sees it ownerless
+ */
+			++this->search.owned[this->package];
+			if(current == std::numeric_limits<std::size_t>::max())
+				--this->search.unresolved;
+			else
+				--this->search.owned[current];
+		}
+	}
 }
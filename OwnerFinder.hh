@@ -23,26 +23,43 @@
 #ifndef __OWNER_FINDER_HH__
 #define __OWNER_FINDER_HH__
 
-#include <paludis/contents.hh>
-#include <paludis/metadata_key.hh>
+#include <atomic>
+#include <memory>
 
 #include "CollisionProtect.hh"
 
+/**
+ * Colliding files looked up by every OwnerFinder
+ * Paths are only read once built, workers just lower the best owner of the slots they found
+ * and count the files each package is the best owner of
+ */
+struct OwnerSearch
+{
+    OwnerSearch(const FSPathList &, std::size_t);
+    bool settled(std::size_t) const;
+    std::unordered_map<std::string, std::size_t> slots;
+    std::vector<std::string> paths;
+    std::unique_ptr<std::atomic<std::size_t>[]> best;
+    std::unique_ptr<std::atomic<std::size_t>[]> owned;
+    std::atomic<std::size_t> unresolved;
+    mutable std::atomic<std::size_t> bound;
+};
+
+/**
+ * Owners found by a worker, as (slot, package index) pairs
+ */
+typedef std::vector<std::pair<std::size_t, std::size_t> > OwnerHits;
+
 class OwnerFinder
 {
     public:
-        OwnerFinder(std::string, std::shared_ptr<const paludis::PackageDepSpec> &, FilesByPackage*);
-        void find(const paludis::FSPath &);
-        bool isFound() const;
-        void visit(const paludis::ContentsFileEntry &);
-        void visit(const paludis::ContentsDirEntry &);
-        void visit(const paludis::ContentsOtherEntry &);
-        void visit(const paludis::ContentsSymEntry &);
+        OwnerFinder(OwnerSearch &, std::size_t, OwnerHits *);
+        void find(const char *, std::size_t);
     private:
-        std::string fileToFind;
-        std::shared_ptr<const paludis::PackageDepSpec> depSpec;
-        FilesByPackage* collisions;
-        bool found;
+        OwnerSearch & search;
+        std::string key;
+        std::size_t package;
+        OwnerHits* hits;
 };
 
 #endif // __OWNER_FINDER_HH__
@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <paludis/dep_spec.hh>
+#include <paludis/util/exception.hh>
+#include <paludis/util/stringify.hh>
+
+#include "CanonicalPath.hh"
+#include "CollisionStats.hh"
+#include "OwnerIndex.hh"
+#include "WorkStealingPool.hh"
+
+namespace
+{
+	const std::string index_magic("collisionprotect-index 4");
+	const std::string directories_magic("collisionprotect-directories 1");
+
+	/**
+	 * Saves made by this process, so that a process saving twice in a second
+	 * never reuses a generation, nor the name of a paths file
+	 */
+	std::atomic<unsigned long> saves(0);
+
+	std::string dirname(const std::string & path)
+	{
+		std::string::size_type slash = path.rfind('/');
+		return slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+	}
+}
+
+OwnerIndex::OwnerIndex(std::string indexFile) :
+    deadPaths(0),
+    compact(false),
+    directoriesLoaded(false)
+{
+    this->indexFile = indexFile;
+}
+
+std::string OwnerIndex::pathsFile(const std::string & pathsGeneration) const
+{
+	return indexFile + ".paths." + pathsGeneration;
+}
+
+/**
+ * Read the index from disk
+ * Only the package table, the filter and the directory map are read,
+ * paths are read on the first lookup needing them
+ * @return whether a valid index was read
+ */
+bool OwnerIndex::load()
+{
+	packages.clear();
+	owners.clear();
+	directories.clear();
+	directoriesLoaded = false;
+	deadPaths = 0;
+	compact = false;
+	pathsGeneration.clear();
+	pathsStream.close();
+	pathsStream.clear();
+	std::ifstream in(indexFile.c_str());
+	std::string line;
+	if(!getline(in, line) || line != index_magic)
+		return false;
+	std::size_t count = 0;
+	if(!getline(in, line) || !(std::istringstream(line) >> generation >> count >> pathsGeneration >> deadPaths))
+	{
+		pathsGeneration.clear();
+		return false;
+	}
+	pathsStream.open(pathsFile(pathsGeneration).c_str());
+	for(std::size_t n(0); n != count && pathsStream; ++n)
+	{
+		Package package;
+		if(!getline(in, line) || !(std::istringstream(line) >> package.stamp >> package.pathCount >> package.offset >> package.owner))
+			break;
+		package.stored = true;
+		package.loaded = false;
+		package.indexed = false;
+		packages.push_back(package);
+	}
+	if(packages.size() != count)
+	{
+		packages.clear();
+		pathsGeneration.clear();
+		return false;
+	}
+	filter.load(indexFile + ".filter", generation);
+	directoriesLoaded = loadDirectories();
+	return true;
+}
+
+/**
+ * Read the paths of every package not read yet and index them all
+ * @return whether the paths are available
+ */
+bool OwnerIndex::loadPaths()
+{
+	for(std::size_t n(0), n_end(packages.size()); n != n_end; ++n)
+	{
+		if(!loadPackage(n))
+		{
+			packages.clear();
+			owners.clear();
+			directories.clear();
+			return false;
+		}
+	}
+	rehash();
+	return true;
+}
+
+/**
+ * Read the paths of one package from its block
+ * @param n Package index
+ * @return whether the paths were read
+ */
+bool OwnerIndex::loadPackage(std::size_t n)
+{
+	Package & package(packages[n]);
+	if(package.loaded)
+		return true;
+	std::istream & in(pathsStream);
+	in.clear();
+	if(!package.stored || !in.seekg(package.offset))
+		return false;
+	std::string line;
+	package.paths.reserve(package.pathCount);
+	for(std::size_t p(0); p != package.pathCount; ++p)
+	{
+		if(!getline(in, line))
+		{
+			package.paths.clear();
+			return false;
+		}
+		package.paths.push_back(line);
+	}
+	package.loaded = true;
+	return true;
+}
+
+/**
+ * Append the blocks of packages read since the last save to the paths file
+ * Other processes may append to it at the same time, so it is locked while the
+ * offset of the blocks is taken and they are written. A paths file compacted away
+ * by another process is not found anymore, a new one is then written instead.
+ * @return whether every package has its block in the paths file
+ */
+bool OwnerIndex::appendPaths()
+{
+	if(pathsGeneration.empty())
+		return false;
+	std::string data;
+	for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+		if(!p->stored)
+			for(std::vector<std::string>::const_iterator path(p->paths.begin()), path_end(p->paths.end()); path != path_end; ++path)
+				data.append(*path).append(1, '\n');
+	int fd = ::open(pathsFile(pathsGeneration).c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	if(fd == -1)
+		return false;
+	::flock(fd, LOCK_EX);
+	off_t end = ::lseek(fd, 0, SEEK_END);
+	std::size_t done = 0;
+	while(end != -1 && done != data.size())
+	{
+		ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+		if(n < 0 && errno != EINTR)
+			break;
+		if(n > 0)
+			done += n;
+	}
+	::close(fd);
+	if(end == -1 || done != data.size())
+		return false;
+	std::streamoff offset = end;
+	for(std::vector<Package>::iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+	{
+		if(p->stored)
+			continue;
+		p->offset = offset;
+		p->stored = true;
+		for(std::vector<std::string>::const_iterator path(p->paths.begin()), path_end(p->paths.end()); path != path_end; ++path)
+			offset += path->size() + 1;
+	}
+	return true;
+}
+
+/**
+ * Write the blocks of every package to a new paths file and rebuild the filter without
+ * the paths of replaced packages. The file is only used once the table naming it is saved.
+ * @param newGeneration Generation of the new paths file
+ * @return whether the paths file was written
+ */
+bool OwnerIndex::compactPaths(const std::string & newGeneration)
+{
+	for(std::size_t n(0), n_end(packages.size()); n != n_end; ++n)
+		if(!loadPackage(n))
+			return false;
+	std::string file(pathsFile(newGeneration));
+	std::ofstream out(file.c_str());
+	std::vector<std::streamoff> offsets;
+	std::streamoff offset = 0;
+	std::size_t count = 0;
+	for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+	{
+		offsets.push_back(offset);
+		count += p->paths.size();
+		for(std::vector<std::string>::const_iterator path(p->paths.begin()), path_end(p->paths.end()); path != path_end; ++path)
+		{
+			out << *path << "\n";
+			offset += path->size() + 1;
+		}
+	}
+	out.close();
+	if(!out)
+	{
+		::unlink(file.c_str());
+		return false;
+	}
+	for(std::size_t n(0), n_end(packages.size()); n != n_end; ++n)
+	{
+		packages[n].offset = offsets[n];
+		packages[n].stored = true;
+	}
+	pathsGeneration = newGeneration;
+	pathsStream.close();
+	pathsStream.clear();
+	pathsStream.open(file.c_str());
+/*
+ * The owners and the directory map only hold live packages, the filter still holds replaced ones
+ */
+	if(deadPaths != 0 || filter.saturated())
+	{
+		filter.reset(count);
+		for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+			for(std::vector<std::string>::const_iterator path(p->paths.begin()), path_end(p->paths.end()); path != path_end; ++path)
+				filter.add(*path);
+	}
+	deadPaths = 0;
+	compact = false;
+	return true;
+}
+
+/**
+ * Read the map of directories to the packages owning entries in them
+ * @return whether a map matching the index was read
+ */
+bool OwnerIndex::loadDirectories()
+{
+	std::ifstream in((indexFile + ".directories").c_str());
+	std::string line, fileGeneration;
+	std::size_t count = 0;
+	if(!getline(in, line) || line != directories_magic)
+		return false;
+	if(!getline(in, line) || !(std::istringstream(line) >> fileGeneration >> count) || fileGeneration != generation)
+		return false;
+	directories.reserve(count);
+	for(std::size_t n(0); n != count; ++n)
+	{
+		if(!getline(in, line))
+		{
+			directories.clear();
+			return false;
+		}
+		std::istringstream fields(line);
+		std::size_t candidates = 0, candidate = 0;
+		fields >> candidates;
+		std::vector<std::size_t> packageIndices;
+		for(std::size_t c(0); c != candidates && fields >> candidate; ++c)
+			if(candidate < packages.size())
+				packageIndices.push_back(candidate);
+		std::string dir;
+		if(fields.get() != ' ' || !getline(fields, dir) || packageIndices.size() != candidates)
+		{
+			directories.clear();
+			return false;
+		}
+		directories[dir].swap(packageIndices);
+	}
+	return true;
+}
+
+/**
+ * Write the map of directories, tagged with the generation of the index
+ * It is written to a temporary file first and renamed, as the index
+ * Each line is the number of packages, their indices and the directory
+ * @return whether the map was written
+ */
+bool OwnerIndex::saveDirectories() const
+{
+	std::ostringstream tmpFile;
+	tmpFile << indexFile << ".directories.tmp." << ::getpid();
+	std::ofstream out(tmpFile.str().c_str());
+	out << directories_magic << "\n" << generation << " " << directories.size() << "\n";
+	for(std::unordered_map<std::string, std::vector<std::size_t> >::const_iterator d(directories.begin()), d_end(directories.end()); d != d_end; ++d)
+	{
+		out << d->second.size();
+		for(std::vector<std::size_t>::const_iterator c(d->second.begin()), c_end(d->second.end()); c != c_end; ++c)
+			out << " " << *c;
+		out << " " << d->first << "\n";
+	}
+	out.close();
+	if(!out || ::rename(tmpFile.str().c_str(), (indexFile + ".directories").c_str()) != 0)
+	{
+		::unlink(tmpFile.str().c_str());
+		return false;
+	}
+	return true;
+}
+/**
+ * Bring the index in line with the installed packages
+ * Packages whose contents file did not change are kept as is, unreadable ones included
+ * as reading them would fail again. Only packages merged or replaced since the last save
+ * are read, their paths being added to the filter and the directory map, from which replaced
+ * and removed packages are dropped. Their blocks are left in the paths file until it is
+ * compacted, as their paths are left in the filter. Lookups keep reading only the packages
+ * of the directory map afterwards.
+ * @param installed Installed packages
+ * @return whether the index needs saving
+ */
+bool OwnerIndex::refresh(const InstalledPackages & installed)
+{
+	std::map<std::string, std::size_t> known;
+	for(std::size_t n(0), n_end(packages.size()); n != n_end; ++n)
+		known.insert(std::make_pair(packages[n].owner, n));
+	bool rebuild = filter.empty() || !directoriesLoaded;
+	bool changed = rebuild || installed.size() != packages.size();
+	std::vector<Package> current(installed.size());
+	std::vector<std::size_t> previous(installed.size(), packages.size());
+	for(std::size_t n(0), n_end(installed.size()); n != n_end; ++n)
+	{
+		current[n].owner = paludis::stringify(*installed.depSpec(n));
+		current[n].stamp = installed.stamp(n);
+		std::map<std::string, std::size_t>::iterator k(known.find(current[n].owner));
+		if(k != known.end() && packages[k->second].stamp == current[n].stamp)
+		{
+			previous[n] = k->second;
+			changed = changed || k->second != n;
+			known.erase(k);
+		}
+		else
+			changed = true;
+	}
+	if(!changed)
+		return false;
+/*
+ * Whatever is left in known was replaced or removed
+ */
+	for(std::map<std::string, std::size_t>::const_iterator k(known.begin()), k_end(known.end()); k != k_end; ++k)
+		if(packages[k->second].stored)
+			deadPaths += packages[k->second].pathCount;
+	std::vector<std::size_t> stale;
+	std::vector<std::size_t> renumber(packages.size(), current.size());
+	for(std::size_t n(0), n_end(current.size()); n != n_end; ++n)
+	{
+		Package & package(current[n]);
+		if(previous[n] != packages.size() && (!rebuild || loadPackage(previous[n])))
+		{
+			std::swap(package, packages[previous[n]]);
+			renumber[previous[n]] = n;
+			continue;
+		}
+		package.offset = 0;
+		package.stored = false;
+		package.loaded = true;
+		stale.push_back(n);
+	}
+/*
+ * Read packages merged or replaced since the last save in parallel, each into its own entry
+ */
+	WorkStealingPool pool;
+	pool.run(stale.size(), [&installed, &current, &stale] (unsigned int, std::size_t s)
+	{
+		std::vector<std::string> & paths(current[stale[s]].paths);
+		try
+		{
+			installed.visitContents(stale[s], [&paths] (const char * path, std::size_t length)
+			{
+				paths.push_back(std::string(length + 1, '\0'));
+				paths.back().resize(canonicalize_path(path, length, &paths.back()[0]));
+			});
+		}
+		catch (paludis::ConfigurationError &)
+		{
+/*
+ * Keep what was read, the package is only read again once its contents file changes
+ */
+		}
+		current[stale[s]].pathCount = paths.size();
+		++collision_stats().packagesScanned;
+		collision_stats().contentsEntries += paths.size();
+	});
+	packages.swap(current);
+	owners.clear();
+	for(std::vector<Package>::iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+		p->indexed = false;
+	if(rebuild)
+	{
+		rehash();
+		compact = true;
+		return true;
+	}
+/*
+ * Renumber the packages of the directory map, dropping those replaced or removed,
+ * then add the packages read
+ */
+	for(std::unordered_map<std::string, std::vector<std::size_t> >::iterator d(directories.begin()); d != directories.end(); )
+	{
+		std::vector<std::size_t>::iterator kept(d->second.begin());
+		for(std::vector<std::size_t>::const_iterator c(d->second.begin()), c_end(d->second.end()); c != c_end; ++c)
+			if(renumber[*c] != packages.size())
+				*kept++ = renumber[*c];
+		d->second.erase(kept, d->second.end());
+		if(d->second.empty())
+			d = directories.erase(d);
+		else
+			++d;
+	}
+	for(std::vector<std::size_t>::const_iterator s(stale.begin()), s_end(stale.end()); s != s_end; ++s)
+		for(std::vector<std::string>::const_iterator path(packages[*s].paths.begin()), path_end(packages[*s].paths.end()); path != path_end; ++path)
+		{
+			filter.add(*path);
+			std::vector<std::size_t> & candidates(directories[dirname(*path)]);
+			if(candidates.empty() || candidates.back() != *s)
+				candidates.push_back(*s);
+		}
+	return true;
+}
+
+/**
+ * Write the index to disk
+ * Blocks of packages read since the last save are appended to the paths file, unless
+ * replaced blocks outweigh live ones or the filter is saturated: every block is then
+ * written to a new paths file and the filter rebuilt. The table is written to a temporary
+ * file and renamed over the old one, the filter and the directory map are written last
+ * and tagged with the generation of the table.
+ * @return whether the index was written
+ */
+bool OwnerIndex::save()
+{
+	std::string::size_type slash = indexFile.rfind('/');
+	if(slash != std::string::npos && slash != 0)
+		::mkdir(indexFile.substr(0, slash).c_str(), 0755);
+	std::ostringstream newGeneration;
+	newGeneration << std::time(nullptr) << "." << ::getpid() << "." << ++saves;
+	std::size_t livePaths = 0;
+	for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+		livePaths += p->pathCount;
+	std::string previousPaths(pathsGeneration);
+	if(compact || deadPaths > livePaths || filter.saturated() || !appendPaths())
+	{
+		if(!compactPaths(newGeneration.str()))
+			return false;
+	}
+	std::ostringstream tmpFile;
+	tmpFile << indexFile << ".tmp." << ::getpid();
+	{
+		std::ofstream out(tmpFile.str().c_str());
+		out << index_magic << "\n" << newGeneration.str() << " " << packages.size() << " " << pathsGeneration << " " << deadPaths << "\n";
+		for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+			out << p->stamp << " " << p->pathCount << " " << p->offset << " " << p->owner << "\n";
+		out.flush();
+		if(!out)
+		{
+			::unlink(tmpFile.str().c_str());
+			return false;
+		}
+	}
+	if(::rename(tmpFile.str().c_str(), indexFile.c_str()) != 0)
+	{
+		::unlink(tmpFile.str().c_str());
+		return false;
+	}
+	if(!previousPaths.empty() && previousPaths != pathsGeneration)
+		::unlink(pathsFile(previousPaths).c_str());
+	generation = newGeneration.str();
+	filter.save(indexFile + ".filter", generation);
+	saveDirectories();
+	return true;
+}
+
+/**
+ * Find the package owning a path
+ * @param path Path to look up
+ * Paths missing from the filter are not owned and are answered without reading the paths,
+ * otherwise only packages owning entries in the directory of the path are read
+ * @return Owner, as its stringified PackageDepSpec, nullptr if the path is not owned
+ */
+const std::string * OwnerIndex::find(const std::string & path)
+{
+	if(!filter.mayContain(path))
+	{
+		++collision_stats().filteredPaths;
+		return nullptr;
+	}
+	if(!directoriesLoaded && !loadPaths())
+		return nullptr;
+	std::unordered_map<std::string, std::vector<std::size_t> >::const_iterator dir(directories.find(dirname(path)));
+	if(dir == directories.end())
+		return nullptr;
+	for(std::vector<std::size_t>::const_iterator c(dir->second.begin()), c_end(dir->second.end()); c != c_end; ++c)
+	{
+		Package & package(packages[*c]);
+		if(package.indexed)
+			continue;
+		if(!loadPackage(*c))
+			return nullptr;
+/*
+ * Keep the first package in repository order as owner, as rehash() does
+ */
+		for(std::vector<std::string>::const_iterator p(package.paths.begin()), p_end(package.paths.end()); p != p_end; ++p)
+		{
+			std::pair<std::unordered_map<std::string, std::size_t>::iterator, bool> inserted(owners.insert(std::make_pair(*p, *c)));
+			if(!inserted.second && inserted.first->second > *c)
+				inserted.first->second = *c;
+		}
+		package.indexed = true;
+	}
+	std::unordered_map<std::string, std::size_t>::const_iterator owner(owners.find(path));
+	if(owner == owners.end())
+		return nullptr;
+	return &packages[owner->second].owner;
+}
+
+/**
+ * Check whether find() can answer a path without reading or indexing any package
+ * @param path Path to look up
+ * @return whether every package that may own the path is indexed
+ */
+bool OwnerIndex::ready(const std::string & path) const
+{
+	if(!filter.mayContain(path))
+		return true;
+	if(!directoriesLoaded)
+		return false;
+	std::unordered_map<std::string, std::vector<std::size_t> >::const_iterator dir(directories.find(dirname(path)));
+	if(dir == directories.end())
+		return true;
+	for(std::vector<std::size_t>::const_iterator c(dir->second.begin()), c_end(dir->second.end()); c != c_end; ++c)
+		if(!packages[*c].indexed)
+			return false;
+	return true;
+}
+
+/**
+ * Rebuild the lookup table, the filter and the directory map from the paths of the packages
+ */
+void OwnerIndex::rehash()
+{
+	std::size_t count = 0;
+	for(std::vector<Package>::const_iterator p(packages.begin()), p_end(packages.end()); p != p_end; ++p)
+		count += p->paths.size();
+	owners.clear();
+	directories.clear();
+	filter.reset(count);
+	for(std::size_t n(0), n_end(packages.size()); n != n_end; ++n)
+	{
+		for(std::vector<std::string>::const_iterator path(packages[n].paths.begin()), path_end(packages[n].paths.end()); path != path_end; ++path)
+		{
+			owners.insert(std::make_pair(*path, n));
+			filter.add(*path);
+			std::vector<std::size_t> & candidates(directories[dirname(*path)]);
+			if(candidates.empty() || candidates.back() != n)
+				candidates.push_back(n);
+		}
+		packages[n].indexed = true;
+	}
+	directoriesLoaded = true;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OWNER_INDEX_HH__
+#define __OWNER_INDEX_HH__
+
+#include <fstream>
+#include <ios>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <paludis/package_id.hh>
+
+#include "InstalledPackages.hh"
+#include "OwnedPathFilter.hh"
+
+/**
+ * On-disk map of every installed path to the package owning it.
+ * The index file holds a table of the packages, each stamped with its contents file
+ * and pointing to the block of its paths in a paths file. refresh() only reads the
+ * contents of packages merged or replaced since the last save, and save() appends
+ * their blocks to the paths file, which is only rewritten once replaced blocks
+ * outweigh live ones. A filter of the owned paths is saved next to it, so that paths
+ * owned by no package are answered without reading any path, and a map of each
+ * directory to the packages owning entries in it, so that other lookups only read
+ * the paths of those packages. The paths file stays open from load() on, so paths
+ * are read from the file the table was read with even if a new one replaced it.
+ * find() reads and indexes packages as needed and is not thread safe, but once ready()
+ * holds for a path it only reads the index and may run concurrently with other such calls.
+ */
+class OwnerIndex
+{
+    public:
+        OwnerIndex(std::string);
+        bool load();
+        bool refresh(const InstalledPackages &);
+        bool save();
+        const std::string * find(const std::string &);
+        bool ready(const std::string &) const;
+    private:
+        struct Package
+        {
+            std::string owner;
+            std::string stamp;
+            std::size_t pathCount;
+            std::streamoff offset;
+            bool stored;
+            bool loaded;
+            bool indexed;
+            std::vector<std::string> paths;
+        };
+        std::string pathsFile(const std::string &) const;
+        bool loadPaths();
+        bool loadPackage(std::size_t);
+        bool appendPaths();
+        bool compactPaths(const std::string &);
+        bool loadDirectories();
+        bool saveDirectories() const;
+        void rehash();
+        std::string indexFile;
+        std::string generation;
+        std::string pathsGeneration;
+        std::ifstream pathsStream;
+        std::size_t deadPaths;
+        bool compact;
+        bool directoriesLoaded;
+        OwnedPathFilter filter;
+        std::unordered_map<std::string, std::vector<std::size_t> > directories;
+        std::vector<Package> packages;
+        std::unordered_map<std::string, std::size_t> owners;
+};
+
+#endif // __OWNER_INDEX_HH__
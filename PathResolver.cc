@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CollisionStats.hh"
+#include "PathResolver.hh"
+
+namespace
+{
+	// Same limit as the kernel's
+	const unsigned int max_symlinks = 40;
+
+	/**
+	 * @return path of an entry of a resolved directory
+	 */
+	std::string child(const std::string & dir, const std::string & name)
+	{
+		return (dir == "/" ? "" : dir) + "/" + name;
+	}
+}
+
+/**
+ * Resolve all symlinks of a path
+ * @param path Absolute path
+ * @return Resolved path, or path itself if it does not exist
+ */
+std::string PathResolver::resolve(const std::string & path)
+{
+	std::string resolved;
+	return resolve(path, 0, resolved) ? resolved : path;
+}
+
+/**
+ * @param path Absolute path
+ * @param depth Number of symlinks followed so far
+ * @param resolved Resolved path
+ * @return false if the path, or the target of a symlink in it, does not exist
+ */
+bool PathResolver::resolve(const std::string & path, unsigned int depth, std::string & resolved)
+{
+	std::string::size_type slash = path.rfind('/');
+	if(slash == std::string::npos || depth > max_symlinks)
+		return false;
+	std::string name(path.substr(slash + 1));
+	if(name.empty() || name == "." || name == "..")
+	{
+		const std::string * dir(directory(path));
+		if(!dir)
+			return false;
+		resolved = *dir;
+		return true;
+	}
+	const std::string * dir(directory(slash == 0 ? "/" : path.substr(0, slash)));
+	if(!dir)
+		return false;
+	resolved = child(*dir, name);
+	struct stat st;
+	++collision_stats().statCalls;
+	if(::lstat(resolved.c_str(), &st) != 0)
+		return false;
+	if(!S_ISLNK(st.st_mode))
+		return true;
+/*
+ * Follow the symlink, its target being resolved like any other path
+ */
+	char target[PATH_MAX];
+	++collision_stats().statCalls;
+	ssize_t length = ::readlink(resolved.c_str(), target, sizeof(target));
+	if(length <= 0 || length == static_cast<ssize_t>(sizeof(target)))
+		return false;
+	std::string next(target, length);
+	if(next[0] != '/')
+		next = child(*dir, next);
+	while(next.size() > 1 && next[next.size() - 1] == '/')
+		next.erase(next.size() - 1);
+	return resolve(next, depth + 1, resolved);
+}
+
+/**
+ * Resolve a directory, remembering the result
+ * The directory is resolved from its resolved parent, so only its last component is
+ * looked at. When its parent has symlinks, the result is the one of the directory
+ * with the resolved parent, so every real directory is looked at once.
+ * @param dir Directory
+ * @return Resolved directory, nullptr if it does not exist or is not a directory
+ */
+const std::string * PathResolver::directory(const std::string & dir)
+{
+	std::unordered_map<std::string, std::string>::iterator cached(directories.find(dir));
+	if(cached != directories.end())
+		return cached->second.empty() ? nullptr : &cached->second;
+/*
+ * The entry stays empty, so missing, while the directory is resolved: a symlink loop
+ * coming back to it fails like it does for realpath(). Rehashing keeps the reference valid.
+ */
+	std::string & resolved(directories[dir]);
+	std::string::size_type slash = dir.rfind('/');
+	if(dir == "/")
+	{
+		resolved = dir;
+		return &resolved;
+	}
+	if(slash == std::string::npos)
+		return nullptr;
+	const std::string * parent(directory(slash == 0 ? "/" : dir.substr(0, slash)));
+	if(!parent)
+		return nullptr;
+	std::string name(dir.substr(slash + 1));
+	if(name.empty() || name == ".")
+		resolved = *parent;
+	else if(name == "..")
+	{
+		std::string::size_type up = parent->rfind('/');
+		resolved = up == 0 ? "/" : parent->substr(0, up);
+	}
+	else if(child(*parent, name) != dir)
+	{
+		const std::string * real(directory(child(*parent, name)));
+		if(real)
+			resolved = *real;
+	}
+	else
+	{
+		struct stat st;
+		++collision_stats().statCalls;
+		if(::lstat(dir.c_str(), &st) != 0)
+			return nullptr;
+		if(S_ISDIR(st.st_mode))
+			resolved = dir;
+		else if(S_ISLNK(st.st_mode))
+		{
+			char target[PATH_MAX];
+			++collision_stats().statCalls;
+			ssize_t length = ::readlink(dir.c_str(), target, sizeof(target));
+			if(length <= 0 || length == static_cast<ssize_t>(sizeof(target)))
+				return nullptr;
+			std::string next(target, length);
+			if(next[0] != '/')
+				next = child(*parent, next);
+			while(next.size() > 1 && next[next.size() - 1] == '/')
+				next.erase(next.size() - 1);
+			const std::string * real(directory(next));
+			if(real)
+				resolved = *real;
+		}
+	}
+	return resolved.empty() ? nullptr : &resolved;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PATH_RESOLVER_HH__
+#define __PATH_RESOLVER_HH__
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * Resolver of symlinks in paths, giving the same results as FSPath::realpath_if_exists()
+ * Each directory is resolved once, from its resolved parent, and remembered, so resolving
+ * a file only costs a lstat() of its last component. Meant to live for one hook invocation,
+ * not thread safe. Every lstat() and readlink() made is counted in the stat calls of the hook,
+ * answers from the cache are not.
+ */
+class PathResolver
+{
+    public:
+        std::string resolve(const std::string &);
+    private:
+        bool resolve(const std::string &, unsigned int, std::string &);
+        const std::string * directory(const std::string &);
+        std::unordered_map<std::string, std::string> directories;
+};
+
+#endif // __PATH_RESOLVER_HH__
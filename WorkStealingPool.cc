@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <thread>
+
+#include <paludis/util/thread_pool.hh>
+
+#include "WorkStealingPool.hh"
+
+/**
+ * @param workers Number of workers, 0 for default_workers()
+ */
+WorkStealingPool::WorkStealingPool(unsigned int workers) :
+    count(workers == 0 ? default_workers() : workers)
+{
+	for(unsigned int n(0); n != count; ++n)
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+}
+
+/**
+ * Loading contents is mostly waiting on the disk, so use twice as many workers as CPUs
+ * to keep enough reads in flight on a cold cache
+ * @return Default number of workers
+ */
+unsigned int WorkStealingPool::default_workers()
+{
+	unsigned int n_procs(std::thread::hardware_concurrency());
+	if (n_procs == 0)
+		n_procs = 1;
+	return 2 * n_procs;
+}
+
+unsigned int WorkStealingPool::workers() const
+{
+	return count;
+}
+
+/**
+ * Run a task for every item and wait for all of them
+ * @param items Number of items, numbered from 0
+ * @param task Called with the worker index and the item
+ */
+void WorkStealingPool::run(std::size_t items, const Task & task)
+{
+	for(unsigned int n(0); n != count; ++n)
+	{
+		queues[n]->items.clear();
+		for(std::size_t i(items * n / count), i_end(items * (n + 1) / count); i != i_end; ++i)
+			queues[n]->items.push_back(i);
+	}
+	paludis::ThreadPool pool;
+	for (unsigned int n(0); n != count; ++n)
+		pool.create_thread(std::bind(&WorkStealingPool::work, this, n, std::cref(task)));
+}
+
+void WorkStealingPool::work(unsigned int worker, const Task & task)
+{
+	std::size_t item;
+	while(take(worker, item))
+		task(worker, item);
+}
+
+/**
+ * Take the next item of a worker's own queue, or steal one from another queue
+ * @param worker Worker index
+ * @param item Item taken
+ * @return false once every queue is empty
+ */
+bool WorkStealingPool::take(unsigned int worker, std::size_t & item)
+{
+	{
+		std::unique_lock<std::mutex> lock(queues[worker]->mutex);
+		if(!queues[worker]->items.empty())
+		{
+			item = queues[worker]->items.front();
+			queues[worker]->items.pop_front();
+			return true;
+		}
+	}
+	for(unsigned int n(1); n != count; ++n)
+	{
+		Queue & victim(*queues[(worker + n) % count]);
+		std::unique_lock<std::mutex> lock(victim.mutex);
+		if(!victim.items.empty())
+		{
+			item = victim.items.back();
+			victim.items.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
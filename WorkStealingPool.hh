@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WORK_STEALING_POOL_HH__
+#define __WORK_STEALING_POOL_HH__
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Pool of workers running a task for each of a range of items, installed packages in practice
+ * Items are dealt in contiguous runs to per-worker queues. A worker whose queue is empty
+ * steals from the back of the others, so a package stuck on a cold disk read only
+ * holds up the worker reading it.
+ */
+class WorkStealingPool
+{
+    public:
+        typedef std::function<void (unsigned int, std::size_t)> Task;
+        WorkStealingPool(unsigned int = 0);
+        unsigned int workers() const;
+        void run(std::size_t, const Task &);
+        static unsigned int default_workers();
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<std::size_t> items;
+        };
+        void work(unsigned int, const Task &);
+        bool take(unsigned int, std::size_t &);
+        unsigned int count;
+        std::vector<std::unique_ptr<Queue> > queues;
+};
+
+#endif // __WORK_STEALING_POOL_HH__
@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a standalone program
+ * measuring the collision check of the CollisionProtect hook for Paludis.
+ * It generates a synthetic installed packages database and ${IMAGE} tree and times each phase.
+ * Run "make bench" to build it into "bin/collision_bench".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <paludis/paludis.hh>
+
+#include "../CollisionCheck.hh"
+#include "../CollisionStats.hh"
+#include "../ContentsReader.hh"
+
+/**
+ * Installed packages read from the synthetic database
+ * Its layout is ${DIR}/vdb/category/package-1/CONTENTS with "obj path md5 mtime" lines,
+ * paths being stored with ${ROOT} already prepended, as the hook compares them.
+ */
+class SyntheticInstalledPackages : public InstalledPackages
+{
+    public:
+        SyntheticInstalledPackages(const std::string &);
+        std::size_t size() const;
+        std::shared_ptr<const paludis::PackageDepSpec> depSpec(std::size_t) const;
+        std::string stamp(std::size_t) const;
+        void visitContents(std::size_t, const ContentsCallback &) const;
+    private:
+        std::vector<std::string> categories;
+        std::vector<std::string> names;
+        std::vector<std::string> contentsFiles;
+};
+
+SyntheticInstalledPackages::SyntheticInstalledPackages(const std::string & vdb)
+{
+	DIR * cats = ::opendir(vdb.c_str());
+	if(!cats)
+		return;
+	while(struct dirent * c = ::readdir(cats))
+	{
+		if(c->d_name[0] == '.')
+			continue;
+		DIR * pkgs = ::opendir((vdb + "/" + c->d_name).c_str());
+		if(!pkgs)
+			continue;
+		while(struct dirent * p = ::readdir(pkgs))
+		{
+			if(p->d_name[0] == '.')
+				continue;
+			std::string pkg(p->d_name);
+			categories.push_back(c->d_name);
+			names.push_back(pkg.substr(0, pkg.rfind('-')));
+			contentsFiles.push_back(vdb + "/" + c->d_name + "/" + pkg + "/CONTENTS");
+		}
+		::closedir(pkgs);
+	}
+	::closedir(cats);
+}
+
+std::size_t SyntheticInstalledPackages::size() const
+{
+	return contentsFiles.size();
+}
+
+std::shared_ptr<const paludis::PackageDepSpec> SyntheticInstalledPackages::depSpec(std::size_t n) const
+{
+	paludis::QualifiedPackageName packageName(paludis::CategoryNamePart(categories[n]), paludis::PackageNamePart(names[n]));
+	return std::make_shared<const paludis::PackageDepSpec>(paludis::make_package_dep_spec({ }).package(packageName));
+}
+
+std::string SyntheticInstalledPackages::stamp(std::size_t n) const
+{
+	struct stat st;
+	std::ostringstream stamp;
+	if(::stat(contentsFiles[n].c_str(), &st) == 0)
+		stamp << st.st_ino << ":" << st.st_size << ":" << st.st_mtim.tv_sec << "." << st.st_mtim.tv_nsec;
+	return stamp.str();
+}
+
+void SyntheticInstalledPackages::visitContents(std::size_t n, const ContentsCallback & callback) const
+{
+	ContentsReader reader;
+	if(!reader.open(contentsFiles[n].substr(0, contentsFiles[n].rfind('/'))))
+		return;
+	ContentsEntry entry;
+	while(reader.next(entry))
+		if(entry.type == ContentsEntry::file)
+			callback(entry.path, entry.length);
+}
+
+namespace
+{
+	struct Options
+	{
+		unsigned long packages;
+		unsigned long filesPerPackage;
+		unsigned long imageFiles;
+		double collisions;
+		double orphans;
+		bool index;
+		bool keep;
+		std::string dir;
+	};
+
+	void make_directories(const std::string & path)
+	{
+		for(std::string::size_type slash(path.find('/', 1)); slash != std::string::npos; slash = path.find('/', slash + 1))
+			::mkdir(path.substr(0, slash).c_str(), 0755);
+		::mkdir(path.c_str(), 0755);
+	}
+
+	void touch(const std::string & path)
+	{
+		make_directories(path.substr(0, path.rfind('/')));
+		std::ofstream(path.c_str());
+	}
+
+	std::string contents_file(const Options & options, unsigned long package)
+	{
+		std::ostringstream pkgDir;
+		pkgDir << options.dir << "/vdb/cat" << package % 50 << "/bench" << package << "-1";
+		return pkgDir.str() + "/CONTENTS";
+	}
+
+	std::string owned_path(unsigned long package, unsigned long file)
+	{
+		std::ostringstream path;
+		path << "/usr/share/bench/p" << package << "/d" << file / 100 << "/f" << file;
+		return path.str();
+	}
+
+	/**
+	 * Generate the synthetic installed packages database, ${ROOT} and ${IMAGE}
+	 * Only files of ${ROOT} that ${IMAGE} collides with are created
+	 */
+	void generate(const Options & options)
+	{
+		std::string root(options.dir + "/root");
+		make_directories(root);
+		for(unsigned long p(0); p != options.packages; ++p)
+		{
+			std::string contentsFile(contents_file(options, p));
+			make_directories(contentsFile.substr(0, contentsFile.rfind('/')));
+			std::ofstream contents(contentsFile.c_str());
+			for(unsigned long f(0); f != options.filesPerPackage; ++f)
+				contents << "obj " << root << owned_path(p, f) << " d41d8cd98f00b204e9800998ecf8427e 1400000000\n";
+		}
+		unsigned long colliding = static_cast<unsigned long>(options.imageFiles * options.collisions);
+		unsigned long orphaned = static_cast<unsigned long>(colliding * options.orphans);
+		std::srand(42);
+		for(unsigned long i(0); i != options.imageFiles; ++i)
+		{
+			std::ostringstream path;
+			if(i < orphaned)
+				path << "/usr/share/bench/orphans/d" << i / 100 << "/o" << i;
+			else if(i < colliding && options.packages != 0 && options.filesPerPackage != 0)
+				path << owned_path(std::rand() % options.packages, std::rand() % options.filesPerPackage);
+			else
+				path << "/usr/share/bench/new/d" << i / 100 << "/n" << i;
+			touch(options.dir + "/image" + path.str());
+			if(i < colliding)
+				touch(root + path.str());
+		}
+	}
+
+	/**
+	 * Merge a new build of the first package, with one more file, as the hook sees it
+	 * before the next check: only its contents file changed
+	 */
+	void merge(const Options & options)
+	{
+		std::string contentsFile(contents_file(options, 0));
+		std::string newFile(contentsFile + ".new");
+		{
+			std::ofstream contents(newFile.c_str());
+			for(unsigned long f(0); f != options.filesPerPackage + 1; ++f)
+				contents << "obj " << options.dir << "/root" << owned_path(0, f) << " d41d8cd98f00b204e9800998ecf8427e 1400000001\n";
+		}
+		::rename(newFile.c_str(), contentsFile.c_str());
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: collision_bench [--packages N] [--files N] [--image N] [--collisions RATIO] [--orphans RATIO] [--index] [--keep] [--dir DIR]" << std::endl;
+		std::exit(1);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	Options options;
+	options.packages = 1500;
+	options.filesPerPackage = 200;
+	options.imageFiles = 20000;
+	options.collisions = 0.05;
+	options.orphans = 0.5;
+	options.index = false;
+	options.keep = false;
+	for(int a(1); a < argc; ++a)
+	{
+		std::string arg(argv[a]);
+		if(arg == "--index")
+			options.index = true;
+		else if(arg == "--keep")
+			options.keep = true;
+		else if(a + 1 == argc)
+			usage();
+		else if(arg == "--packages")
+			options.packages = std::strtoul(argv[++a], nullptr, 10);
+		else if(arg == "--files")
+			options.filesPerPackage = std::strtoul(argv[++a], nullptr, 10);
+		else if(arg == "--image")
+			options.imageFiles = std::strtoul(argv[++a], nullptr, 10);
+		else if(arg == "--collisions")
+			options.collisions = std::strtod(argv[++a], nullptr);
+		else if(arg == "--orphans")
+			options.orphans = std::strtod(argv[++a], nullptr);
+		else if(arg == "--dir")
+			options.dir = argv[++a];
+		else
+			usage();
+	}
+	bool temporary = options.dir.empty();
+	if(temporary)
+	{
+		char dirTemplate[] = "/tmp/collision_bench.XXXXXX";
+		if(!::mkdtemp(dirTemplate))
+		{
+			std::cerr << "Cannot create a temporary directory" << std::endl;
+			return 1;
+		}
+		options.dir = dirTemplate;
+	}
+
+	std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+	generate(options);
+	std::cout << "generate: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+/*
+ * The phases print progress on std::cout, silence it while timing them
+ */
+	std::ostringstream discarded;
+	std::streambuf * coutBuf = std::cout.rdbuf(discarded.rdbuf());
+	FSPathList imageFileList;
+	ContentsList installedPkgFilesList;
+	FilesByPackage collisions;
+	std::shared_ptr<const paludis::PackageDepSpec> depSpec(std::make_shared<const paludis::PackageDepSpec>(paludis::make_package_dep_spec({ }).package(paludis::QualifiedPackageName(paludis::CategoryNamePart("bench"), paludis::PackageNamePart("image")))));
+	CollisionStats & stats(collision_stats());
+	unsigned long packagesScanned = 0, contentsEntries = 0;
+
+	stats.startPhase("walk");
+	iterate_over_directory(paludis::FSPath(options.dir + "/image"), &imageFileList, CollisionIgnore(std::vector<std::string>()), options.dir + "/root");
+	stats.startPhase("compare");
+	PathResolver resolver;
+	compareFilesList(imageFileList, installedPkgFilesList, resolver);
+	stats.startPhase(options.index ? "owners_index_build" : "owners");
+	SyntheticInstalledPackages installed(options.dir + "/vdb");
+	if(options.index)
+	{
+		// First run builds the index, second one only probes it
+		find_owners_in_index(installed, options.dir + "/owners.index", depSpec, imageFileList, collisions);
+		collisions.clear();
+		stats.startPhase("owners");
+		find_owners_in_index(installed, options.dir + "/owners.index", depSpec, imageFileList, collisions);
+		// Then a package is merged and the next check refreshes the index, as the hook does
+		stats.stopPhase();
+		if(options.packages != 0)
+			merge(options);
+		collisions.clear();
+		packagesScanned = stats.packagesScanned;
+		contentsEntries = stats.contentsEntries;
+		stats.startPhase("owners_after_merge");
+		find_owners_in_index(installed, options.dir + "/owners.index", depSpec, imageFileList, collisions);
+		packagesScanned = stats.packagesScanned - packagesScanned;
+		contentsEntries = stats.contentsEntries - contentsEntries;
+	}
+	else
+		find_owners(installed, depSpec, imageFileList, collisions);
+	stats.startPhase("report");
+	print_collisions(discarded, collisions, depSpec);
+	stats.stopPhase();
+	std::cout.rdbuf(coutBuf);
+
+	std::size_t colliding = 0;
+	for(FilesByPackage::const_iterator c(collisions.begin()), c_end(collisions.end()); c != c_end; ++c)
+		colliding += c->second.size();
+	std::cout << "files: " << imageFileList.size() << ", colliding: " << colliding << ", owners: " << collisions.size() << std::endl;
+	std::cout << "stat calls: " << stats.statCalls << ", packages scanned: " << stats.packagesScanned << ", contents entries: " << stats.contentsEntries << ", filtered paths: " << stats.filteredPaths << std::endl;
+	if(options.index)
+		std::cout << "after merge: packages scanned: " << packagesScanned << ", contents entries: " << contentsEntries << std::endl;
+	const char * const phases[] = { "walk", "compare", "owners_index_build", "owners", "owners_after_merge", "report" };
+	for(const char * phase : phases)
+		if(options.index || (std::string(phase) != "owners_index_build" && std::string(phase) != "owners_after_merge"))
+			std::cout << phase << ": " << stats.phaseTime(phase) << " ms" << std::endl;
+
+	if(temporary && !options.keep && std::system(("rm -rf '" + options.dir + "'").c_str()) != 0)
+		std::cerr << "Cannot remove " << options.dir << std::endl;
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../ContentsScanner.hh"
+
+/**
+ * Benchmark of the contents scanner implementations
+ * A synthetic VDB CONTENTS buffer is split into lines and fields by each implementation
+ * the CPU supports, they have to agree on every boundary.
+ */
+
+namespace
+{
+	std::string generate(unsigned long lines)
+	{
+		std::ostringstream contents;
+		for(unsigned long n(0); n != lines; ++n)
+		{
+			if(n % 20 == 0)
+				contents << "dir /usr/share/bench/p" << n / 200 << "/d" << n % 200 << "\n";
+			else if(n % 20 == 1)
+				contents << "sym /usr/lib64/libbench" << n << ".so -> libbench" << n << ".so.1.2.3 1400000000\n";
+			else
+				contents << "obj /usr/share/bench/p" << n / 200 << "/d" << n % 200 << "/some file " << n << ".dat d41d8cd98f00b204e9800998ecf8427e 1400000000\n";
+		}
+		return contents.str();
+	}
+
+	unsigned long checksum(const ContentsScanner & scanner, const std::string & contents, unsigned long & lines)
+	{
+		const char * base = contents.data();
+		const char * pos = base;
+		const char * end = base + contents.size();
+		unsigned long sum = 0;
+		ContentsLine line;
+		lines = 0;
+		while(scanner.next(pos, end, line))
+		{
+			++lines;
+			sum += (line.end - base);
+			sum += line.firstSpace ? line.firstSpace - base : 1;
+			sum += line.lastSpace ? line.lastSpace - base : 3;
+			sum += line.previousSpace ? line.previousSpace - base : 7;
+		}
+		return sum;
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: contents_scan_bench [--lines N] [--rounds N]" << std::endl;
+		std::exit(1);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long lines = 2500000;
+	unsigned long rounds = 5;
+	for(int a(1); a < argc; ++a)
+	{
+		std::string arg(argv[a]);
+		if(a + 1 == argc)
+			usage();
+		else if(arg == "--lines")
+			lines = std::strtoul(argv[++a], nullptr, 10);
+		else if(arg == "--rounds")
+			rounds = std::strtoul(argv[++a], nullptr, 10);
+		else
+			usage();
+	}
+	if(rounds == 0)
+		usage();
+
+	std::string contents(generate(lines));
+	std::cout << lines << " lines, " << contents.size() / (1024.0 * 1024.0) << " MiB" << std::endl;
+	const ContentsScanner::Implementation implementations[] = { ContentsScanner::scalar, ContentsScanner::sse2, ContentsScanner::avx2 };
+	unsigned long reference = 0;
+	bool first = true;
+	int status = 0;
+	for(ContentsScanner::Implementation implementation : implementations)
+	{
+		if(!ContentsScanner::supported(implementation))
+		{
+			std::cout << ContentsScanner::name(implementation) << ": not supported" << std::endl;
+			continue;
+		}
+		ContentsScanner scanner(implementation);
+		double best = 0;
+		unsigned long sum = 0, scanned = 0;
+		for(unsigned long r(0); r != rounds; ++r)
+		{
+			std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+			sum = checksum(scanner, contents, scanned);
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if(r == 0 || elapsed < best)
+				best = elapsed;
+		}
+		std::cout << ContentsScanner::name(implementation) << ": " << best << " ms, "
+			<< contents.size() / (1024.0 * 1024.0) / (best / 1000.0) << " MiB/s, " << scanned << " lines" << std::endl;
+		if(first)
+			reference = sum;
+		else if(sum != reference)
+		{
+			std::cerr << ContentsScanner::name(implementation) << ": boundaries differ from scalar" << std::endl;
+			status = 1;
+		}
+		first = false;
+	}
+	return status;
+}
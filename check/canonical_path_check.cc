@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../CanonicalPath.hh"
+
+/**
+ * Check of canonicalize_path() against a straightforward reference
+ * The reference splits the path on slashes like posixpath.normpath() does, except that
+ * an empty path stays empty and a leading "//" is not kept. Fixed cases hold the answers
+ * of posixpath.normpath(), random paths are made of the components the normaliser
+ * treats specially. Every overload has to give the same answer.
+ */
+
+namespace
+{
+	std::string reference(const std::string & path)
+	{
+		if(path.empty())
+			return "";
+		bool absolute = path[0] == '/';
+		std::vector<std::string> components;
+		std::string::size_type start = 0;
+		while(start <= path.size())
+		{
+			std::string::size_type slash = path.find('/', start);
+			if(slash == std::string::npos)
+				slash = path.size();
+			std::string component(path.substr(start, slash - start));
+			start = slash + 1;
+			if(component.empty() || component == ".")
+				continue;
+			if(component == ".." && !components.empty() && components.back() != "..")
+				components.pop_back();
+			else if(component != ".." || !absolute)
+				components.push_back(component);
+		}
+		std::string result(absolute ? "/" : "");
+		for(std::vector<std::string>::const_iterator c(components.begin()), c_end(components.end()); c != c_end; ++c)
+			result += (c == components.begin() ? "" : "/") + *c;
+		return result.empty() ? "." : result;
+	}
+
+	bool check(const std::string & path, const std::string & expected)
+	{
+		std::vector<char> buffer(path.size() + 1);
+		std::string inPlace(path);
+		canonicalize_path_in_place(inPlace);
+		std::string results[] = {
+			canonicalize_path(path),
+			std::string(&buffer[0], canonicalize_path(path.data(), path.size(), &buffer[0])),
+			inPlace
+		};
+		for(unsigned int n(0); n != sizeof(results) / sizeof(results[0]); ++n)
+		{
+			if(results[n] != expected)
+			{
+				std::cerr << "canonicalize_path(\"" << path << "\") #" << n << " gave \"" << results[n] << "\", expected \"" << expected << "\"" << std::endl;
+				return false;
+			}
+		}
+		if(canonicalize_path(expected) != expected)
+		{
+			std::cerr << "canonicalize_path(\"" << expected << "\") is not stable" << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned long count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+	const char * fixed[][2] = {
+		{ "", "" },
+		{ ".", "." },
+		{ "./", "." },
+		{ "/", "/" },
+		{ "//a", "/a" },
+		{ "///a//b/", "/a/b" },
+		{ "a/../..", ".." },
+		{ "/..", "/" },
+		{ "../a/./b/..", "../a" },
+		{ "a/..", "." },
+		{ "/a/b/../../..", "/" },
+		{ "a//", "a" },
+		{ "/usr/lib/../lib64/./libc.so", "/usr/lib64/libc.so" },
+		{ "/a/.../b", "/a/.../b" },
+		{ "/a/..b/.c", "/a/..b/.c" }
+	};
+	unsigned long failures = 0;
+	for(unsigned int n(0); n != sizeof(fixed) / sizeof(fixed[0]); ++n)
+		failures += !check(fixed[n][0], fixed[n][1]);
+	const char * components[] = { "", ".", "..", "...", "a", "bc", ".d", "e." };
+	std::srand(1);
+	for(unsigned long n(0); n != count; ++n)
+	{
+		std::string path(std::rand() % 2 ? "/" : "");
+		for(int c(std::rand() % 8); c != 0; --c)
+			path += std::string(components[std::rand() % 8]) + (std::rand() % 4 ? "/" : "//");
+		if(std::rand() % 2 && !path.empty())
+			path.erase(path.size() - 1);
+		failures += !check(path, reference(path));
+	}
+	std::cout << "canonical_path_check: " << count << " random paths, " << failures << " failures" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
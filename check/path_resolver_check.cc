@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../CollisionStats.hh"
+#include "../PathResolver.hh"
+
+/**
+ * Check of PathResolver against realpath()
+ * A scratch tree holds relative, absolute, chained and directory symlinks, a loop,
+ * dangling links and links climbing with "..". Every path built from its entries has
+ * to resolve like realpath() does, or to itself when realpath() fails, and twice in a
+ * row to exercise the directory cache. A fresh resolver then has to make exactly the
+ * lstat() and readlink() calls of the components it has not seen yet.
+ */
+
+namespace
+{
+	std::string real_path(const std::string & path)
+	{
+		char * resolved = ::realpath(path.c_str(), nullptr);
+		if(!resolved)
+			return path;
+		std::string result(resolved);
+		std::free(resolved);
+		return result;
+	}
+
+	bool make_tree(const std::string & base)
+	{
+		const char * dirs[] = { "usr", "usr/lib64", "usr/share", "usr/share/doc", "opt" };
+		for(unsigned int n(0); n != sizeof(dirs) / sizeof(dirs[0]); ++n)
+			if(::mkdir((base + "/" + dirs[n]).c_str(), 0755) != 0)
+				return false;
+		const char * files[] = { "usr/lib64/libc.so.6", "usr/share/doc/README", "opt/file" };
+		for(unsigned int n(0); n != sizeof(files) / sizeof(files[0]); ++n)
+			if(::close(::creat((base + "/" + files[n]).c_str(), 0644)) != 0)
+				return false;
+		const char * links[][2] = {
+			{ "lib64", "usr/lib" },
+			{ "libc.so.6", "usr/lib64/libc.so" },
+			{ "libc.so", "usr/lib64/chain" },
+			{ "/usr/lib64/libc.so", "usr/lib64/absolute" },
+			{ "share", "usr/link" },
+			{ "../usr/share/doc", "opt/doc" },
+			{ "../../opt", "usr/share/up" },
+			{ "loop-b", "usr/loop-a" },
+			{ "loop-a", "usr/loop-b" },
+			{ "missing", "usr/dangling" },
+			{ "dangling", "usr/dangling-chain" },
+			{ ".", "usr/self" },
+			{ "doc/", "usr/share/trailing" }
+		};
+		for(unsigned int n(0); n != sizeof(links) / sizeof(links[0]); ++n)
+		{
+			std::string target(links[n][0]);
+			if(target[0] == '/')
+				target = base + target;
+			if(::symlink(target.c_str(), (base + "/" + links[n][1]).c_str()) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Check the system calls made by a fresh resolver for a sequence of paths
+	 * @param base Scratch tree, without symlinks
+	 * @return Number of paths whose resolution did not cost what was expected
+	 */
+	unsigned long check_calls(const std::string & base)
+	{
+		unsigned long baseComponents = 0;
+		for(std::string::const_iterator c(base.begin()), c_end(base.end()); c != c_end; ++c)
+			if(*c == '/')
+				++baseComponents;
+/*
+ * usr/link is a symlink to share, already resolved by then, and so is usr/link/doc.
+ * usr/share/up leads to opt, then opt/doc back to usr/share/doc. Each link of the
+ * loop is read once, then the loop is known to be missing.
+ */
+		struct
+		{
+			const char * path;
+			unsigned long calls;
+		} expected[] = {
+			{ "/usr/share/doc/README", baseComponents + 4 },
+			{ "/usr/share/doc/README", 1 },
+			{ "/usr/share/doc/missing", 1 },
+			{ "/usr/link/doc/README", 3 },
+			{ "/usr/link/doc/README", 1 },
+			{ "/usr/share/up/doc/README", 6 },
+			{ "/usr/loop-a/file", 4 },
+			{ "/usr/loop-a/file", 0 }
+		};
+		unsigned long failures = 0;
+		PathResolver resolver;
+		for(unsigned int n(0); n != sizeof(expected) / sizeof(expected[0]); ++n)
+		{
+			unsigned long before(collision_stats().statCalls);
+			resolver.resolve(base + expected[n].path);
+			unsigned long calls(collision_stats().statCalls - before);
+			if(calls != expected[n].calls)
+			{
+				++failures;
+				std::cerr << "resolve(\"" << base << expected[n].path << "\") made " << calls << " calls, expected "
+					<< expected[n].calls << std::endl;
+			}
+		}
+		return failures;
+	}
+}
+
+int main()
+{
+	char scratch[] = "/tmp/path_resolver_check.XXXXXX";
+	if(!::mkdtemp(scratch))
+		return 1;
+	std::string base(real_path(scratch));
+	if(!make_tree(base))
+	{
+		std::cerr << "path_resolver_check: cannot build the tree in " << base << std::endl;
+		return 1;
+	}
+	const char * components[] = { "usr", "lib", "lib64", "libc.so", "libc.so.6", "chain", "absolute", "link", "share", "doc",
+		"README", "opt", "up", "file", "loop-a", "loop-b", "dangling", "dangling-chain", "self", "trailing", "missing" };
+	const unsigned int count = sizeof(components) / sizeof(components[0]);
+	std::vector<std::string> paths;
+	for(unsigned int a(0); a != count; ++a)
+	{
+		paths.push_back(base + "/" + components[a]);
+		for(unsigned int b(0); b != count; ++b)
+		{
+			paths.push_back(base + "/" + components[a] + "/" + components[b]);
+			for(unsigned int c(0); c != count; ++c)
+				paths.push_back(base + "/" + components[a] + "/" + components[b] + "/" + components[c]);
+		}
+	}
+	paths.push_back(base + "/usr/share/up/doc/README");
+	paths.push_back(base + "/usr/self/self/lib/chain");
+	unsigned long failures = 0;
+	PathResolver resolver;
+	for(unsigned int round(0); round != 2; ++round)
+	{
+		for(std::vector<std::string>::const_iterator p(paths.begin()), p_end(paths.end()); p != p_end; ++p)
+		{
+			std::string expected(real_path(*p)), resolved(resolver.resolve(*p));
+			if(resolved != expected)
+			{
+				if(++failures <= 20)
+					std::cerr << "resolve(\"" << *p << "\") gave \"" << resolved << "\", expected \"" << expected << "\"" << std::endl;
+			}
+		}
+	}
+	failures += check_calls(base);
+	std::string command("rm -rf '" + base + "'");
+	if(std::system(command.c_str()) != 0)
+		std::cerr << "path_resolver_check: cannot remove " << base << std::endl;
+	std::cout << "path_resolver_check: " << paths.size() << " paths, " << failures << " failures" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <paludis/paludis.hh>
+
+#include "../CanonicalPath.hh"
+#include "../CollisionProtect.hh"
+#include "../InstalledPackages.hh"
+#include "../OwnerClient.hh"
+#include "../OwnerIndex.hh"
+
+/**
+ * Daemon keeping the owner index in memory and answering owner queries of the hook
+ * A refresher thread invalidates installed repositories and refreshes the index on a timer
+ * and whenever queries ask for it. Each query waits for a refresh started after it arrived,
+ * so packages merged since the previous query are taken into account, and queries arriving
+ * together share one refresh. Lookups share the index lock, which is only taken alone
+ * to apply a refresh or to index packages no lookup has needed yet.
+ * Queries for another ${ROOT} or other installed repositories are refused.
+ */
+
+namespace
+{
+	volatile std::sig_atomic_t stopping = 0;
+
+	void stop(int)
+	{
+		stopping = 1;
+	}
+
+	/**
+	 * Seconds a client may take to send its query or read the answer
+	 */
+	const int client_timeout = 10;
+
+	/**
+	 * Seconds between two refreshes nobody asked for
+	 */
+	const int refresh_interval = 30;
+
+	/**
+	 * Connections served at once, further clients wait in the listen backlog
+	 */
+	const unsigned int max_connections = 32;
+
+	/**
+	 * Seconds to wait before accepting again after accept() failed for lack of resources
+	 */
+	const int accept_backoff = 1;
+
+	/**
+	 * State shared by the connections and the refresher
+	 * The environment is only used by the refresher. The index lock is shared by lookups
+	 * and held alone while the index changes.
+	 */
+	struct Daemon
+	{
+		std::shared_ptr<paludis::Environment> env;
+		std::string root;
+		std::string repositories;
+		OwnerIndex * index;
+		pthread_rwlock_t indexLock;
+		std::mutex refreshMutex;
+		std::condition_variable refreshWanted;
+		std::condition_variable refreshDone;
+		unsigned long refreshesRequested;
+		unsigned long refreshesDone;
+		std::string refreshError;
+		bool exiting;
+		std::mutex connectionsMutex;
+		std::condition_variable connectionsDone;
+		unsigned int connections;
+	};
+
+	/**
+	 * Hold the index lock for a scope, shared or alone
+	 */
+	class IndexLock
+	{
+		public:
+			IndexLock(pthread_rwlock_t & lock, bool shared) :
+				lock(lock)
+			{
+				if(shared)
+					::pthread_rwlock_rdlock(&lock);
+				else
+					::pthread_rwlock_wrlock(&lock);
+			}
+
+			~IndexLock()
+			{
+				::pthread_rwlock_unlock(&lock);
+			}
+		private:
+			IndexLock(const IndexLock &);
+			IndexLock & operator=(const IndexLock &);
+			pthread_rwlock_t & lock;
+	};
+
+	/**
+	 * Leave SIGINT and SIGTERM to the main thread, so that they interrupt accept()
+	 */
+	void block_stop_signals()
+	{
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+		::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	}
+
+	/**
+	 * Refresh the index from the installed repositories
+	 * Repositories are enumerated without the index lock, which is only taken alone
+	 * while the index reads the packages that changed and is saved.
+	 * @param daemon Daemon state
+	 * @return the error message, empty if the refresh succeeded
+	 */
+	std::string refresh(Daemon & daemon)
+	{
+		try
+		{
+			for(paludis::Environment::RepositoryConstIterator r(daemon.env->begin_repositories()), r_end(daemon.env->end_repositories()); r != r_end; ++r)
+				if((*r)->installed_root_key())
+					(*r)->invalidate();
+			EnvironmentInstalledPackages installed(daemon.env.get());
+			IndexLock lock(daemon.indexLock, false);
+			if(daemon.index->refresh(installed))
+				daemon.index->save();
+		}
+		catch (paludis::Exception & ex)
+		{
+			return ex.message();
+		}
+		return "";
+	}
+
+	/**
+	 * Refresh the index every refresh_interval seconds and whenever a query asks for it
+	 * Every query waiting when a refresh starts is answered by that refresh.
+	 * @param daemon Daemon state
+	 */
+	void refresher(Daemon & daemon)
+	{
+		block_stop_signals();
+		std::unique_lock<std::mutex> lock(daemon.refreshMutex);
+		while(!daemon.exiting)
+		{
+			if(daemon.refreshesRequested == daemon.refreshesDone)
+				daemon.refreshWanted.wait_for(lock, std::chrono::seconds(refresh_interval));
+			if(daemon.exiting)
+				break;
+			unsigned long requested(daemon.refreshesRequested);
+			lock.unlock();
+			std::string error(refresh(daemon));
+			lock.lock();
+			daemon.refreshError = error;
+			daemon.refreshesDone = requested;
+			daemon.refreshDone.notify_all();
+		}
+	}
+
+	/**
+	 * Answer one query
+	 * @param fd Connection to the client
+	 * @param daemon Daemon state
+	 */
+	void serve(int fd, Daemon & daemon)
+	{
+		std::string request;
+		if(!read_all(fd, request))
+			return;
+		std::istringstream in(request);
+		std::string line, root, repositories;
+		std::size_t count = 0;
+		if(!getline(in, line) || line != owner_protocol_magic || !getline(in, root) || !getline(in, repositories)
+				|| !getline(in, line) || !(std::istringstream(line) >> count))
+		{
+			write_all(fd, "error malformed query\n");
+			return;
+		}
+		if(canonicalize_path(root) != daemon.root || repositories != daemon.repositories)
+		{
+			write_all(fd, "error environment mismatch, serving " + daemon.root + "\n");
+			return;
+		}
+		std::vector<std::string> paths;
+		for(std::size_t n(0); n != count && getline(in, line); ++n)
+		{
+			canonicalize_path_in_place(line);
+			paths.push_back(line);
+		}
+		{
+			std::unique_lock<std::mutex> lock(daemon.refreshMutex);
+			unsigned long requested(++daemon.refreshesRequested);
+			daemon.refreshWanted.notify_one();
+			while(daemon.refreshesDone < requested)
+				daemon.refreshDone.wait(lock);
+			if(!daemon.refreshError.empty())
+			{
+				std::string error(daemon.refreshError);
+				lock.unlock();
+				write_all(fd, "error " + error + "\n");
+				return;
+			}
+		}
+/*
+ * Owners are copied under the lock, a later refresh may replace them
+ */
+		std::vector<std::string> owners(paths.size());
+		std::vector<std::size_t> unready;
+		{
+			IndexLock lock(daemon.indexLock, true);
+			for(std::size_t n(0); n != paths.size(); ++n)
+			{
+				if(!daemon.index->ready(paths[n]))
+				{
+					unready.push_back(n);
+					continue;
+				}
+				const std::string * owner(daemon.index->find(paths[n]));
+				owners[n] = owner ? *owner : "-";
+			}
+		}
+		if(!unready.empty())
+		{
+			IndexLock lock(daemon.indexLock, false);
+			for(std::vector<std::size_t>::const_iterator n(unready.begin()), n_end(unready.end()); n != n_end; ++n)
+			{
+				const std::string * owner(daemon.index->find(paths[*n]));
+				owners[*n] = owner ? *owner : "-";
+			}
+		}
+		std::string answer("ok\n");
+		for(std::vector<std::string>::const_iterator o(owners.begin()), o_end(owners.end()); o != o_end; ++o)
+			answer += *o + "\n";
+		write_all(fd, answer);
+	}
+
+	/**
+	 * Serve a connection on its own thread, so that a slow client does not hold up the others
+	 * @param fd Connection to the client
+	 * @param daemon Daemon state
+	 */
+	void serve_connection(int fd, Daemon & daemon)
+	{
+		block_stop_signals();
+		struct timeval timeout;
+		timeout.tv_sec = client_timeout;
+		timeout.tv_usec = 0;
+		::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		serve(fd, daemon);
+		::close(fd);
+		std::unique_lock<std::mutex> lock(daemon.connectionsMutex);
+		--daemon.connections;
+		daemon.connectionsDone.notify_all();
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: collision_owner_daemon [--environment SPEC] [--socket FILE] [--index FILE]" << std::endl;
+		std::exit(1);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	std::string environment;
+	std::string socketFile(owner_socket_file());
+	std::string indexFile(owner_index_file());
+	for(int a(1); a < argc; ++a)
+	{
+		std::string arg(argv[a]);
+		if(a + 1 == argc)
+			usage();
+		else if(arg == "--environment")
+			environment = argv[++a];
+		else if(arg == "--socket")
+			socketFile = argv[++a];
+		else if(arg == "--index")
+			indexFile = argv[++a];
+		else
+			usage();
+	}
+	if(socketFile.empty() || indexFile.empty())
+		usage();
+
+	Daemon daemon;
+	daemon.env = paludis::EnvironmentFactory::get_instance()->create(environment);
+	daemon.root = canonicalize_path(paludis::stringify(daemon.env->preferred_root_key()->parse_value()));
+	daemon.repositories = installed_repositories(daemon.env.get());
+	daemon.connections = 0;
+	daemon.refreshesRequested = 0;
+	daemon.refreshesDone = 0;
+	daemon.exiting = false;
+	::pthread_rwlock_init(&daemon.indexLock, nullptr);
+	OwnerIndex index(indexFile);
+	daemon.index = &index;
+	index.load();
+	{
+		EnvironmentInstalledPackages installed(daemon.env.get());
+		if(index.refresh(installed))
+			index.save();
+	}
+
+	struct sockaddr_un address;
+	if(socketFile.size() >= sizeof(address.sun_path))
+	{
+		std::cerr << "Socket path too long: " << socketFile << std::endl;
+		return 1;
+	}
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, socketFile.c_str());
+	int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	::unlink(socketFile.c_str());
+	// Only root may query the daemon
+	mode_t mask = ::umask(077);
+	bool bound = listenFd != -1 && ::bind(listenFd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) == 0;
+	::umask(mask);
+	if(!bound || ::listen(listenFd, 16) != 0)
+	{
+		std::cerr << "Cannot listen on " << socketFile << ": " << std::strerror(errno) << std::endl;
+		return 1;
+	}
+
+/*
+ * No SA_RESTART, so that a signal interrupts accept()
+ */
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_handler = &stop;
+	::sigaction(SIGINT, &action, nullptr);
+	::sigaction(SIGTERM, &action, nullptr);
+	::signal(SIGPIPE, SIG_IGN);
+	std::thread refresherThread(&refresher, std::ref(daemon));
+
+	while(!stopping)
+	{
+/*
+ * Wake up now and then while all connections are busy, so that a signal is noticed
+ */
+		{
+			std::unique_lock<std::mutex> lock(daemon.connectionsMutex);
+			while(daemon.connections >= max_connections && !stopping)
+				daemon.connectionsDone.wait_for(lock, std::chrono::seconds(1));
+		}
+		if(stopping)
+			break;
+		int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if(fd == -1)
+		{
+/*
+ * Out of descriptors or memory, accepting again at once would only fail again
+ */
+			int error(errno);
+			if(error != EINTR && error != ECONNABORTED)
+			{
+				std::cerr << "Cannot accept connections: " << std::strerror(error) << std::endl;
+				::sleep(accept_backoff);
+			}
+			continue;
+		}
+		{
+			std::unique_lock<std::mutex> lock(daemon.connectionsMutex);
+			++daemon.connections;
+		}
+		std::thread(&serve_connection, fd, std::ref(daemon)).detach();
+	}
+	::close(listenFd);
+	{
+		std::unique_lock<std::mutex> lock(daemon.connectionsMutex);
+		while(daemon.connections != 0)
+			daemon.connectionsDone.wait(lock);
+	}
+	{
+		std::unique_lock<std::mutex> lock(daemon.refreshMutex);
+		daemon.exiting = true;
+		daemon.refreshWanted.notify_one();
+	}
+	refresherThread.join();
+	::pthread_rwlock_destroy(&daemon.indexLock);
+	::unlink(socketFile.c_str());
+	return 0;
+}
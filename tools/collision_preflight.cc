@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2026 Pierre Lejeune
+ *
+ * This source file is intended to be compiled as a shared library
+ * to be used as a hook for Paludis, the other Package Mangler.
+ * It checks whether there is collisions with existing files and abort the installation if needed.
+ * To use it, copy it or make a link to it into "${SHAREDIR}/paludis/merger_check_post".
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include <sys/stat.h>
+
+#include <paludis/paludis.hh>
+
+#include "../pstream.h"
+
+#include "../CanonicalPath.hh"
+#include "../CollisionCheck.hh"
+#include "../CollisionIgnore.hh"
+#include "../CollisionProtect.hh"
+#include "../InstalledPackages.hh"
+#include "../OwnerClient.hh"
+#include "../OwnerIndex.hh"
+#include "../WorkStealingPool.hh"
+
+/**
+ * Check binary packages or ${IMAGE} directories for collisions before installing them
+ * Ownership of installed files is loaded once for all candidates, which are also checked
+ * against each other. Exits with 1 when any collision is found.
+ */
+
+namespace
+{
+	struct Candidate
+	{
+		std::string location;
+		std::string package;
+		FSPathList files;
+		std::string error;
+	};
+
+	/**
+	 * List files of a binary package archive
+	 * @param candidate Candidate whose location is an archive
+	 * @param prefix Directory of the archive holding the image, empty for the whole archive
+	 * @param collIgnore Directories to discard
+	 * @param root ${ROOT} directory, without trailing slash
+	 */
+	void list_archive(Candidate & candidate, const std::string & prefix, const CollisionIgnore & collIgnore, const std::string & root)
+	{
+		std::vector<std::string> argv;
+		argv.push_back("tar");
+		argv.push_back("-tf");
+		argv.push_back(candidate.location);
+		redi::ipstream tar("tar", argv, redi::pstreambuf::pstdout);
+		std::string entry;
+		while(getline(tar, entry))
+		{
+			if(entry.compare(0, 2, "./") == 0)
+				entry.erase(0, 2);
+			if(entry.compare(0, prefix.size(), prefix) != 0)
+				continue;
+			entry.erase(0, prefix.size());
+			if(entry.empty() || entry[entry.size() - 1] == '/')
+				continue;
+			std::string path(canonicalize_path(root + "/" + entry));
+			struct stat st;
+			bool exists = false;
+			if(!collIgnore.matches(path))
+			{
+				exists = ::lstat(path.c_str(), &st) == 0;
+				if(!exists && errno != ENOENT && errno != ENOTDIR && candidate.error.empty())
+					candidate.error = "cannot stat " + path + ": " + std::strerror(errno);
+			}
+			candidate.files.add(path, exists);
+		}
+		tar.close();
+		if(tar.rdbuf()->exited() && tar.rdbuf()->status() != 0)
+			candidate.error = "cannot list archive";
+		candidate.files.sort();
+	}
+
+	/**
+	 * Check whether an owner is an installed version of a package
+	 * @param owner Stringified PackageDepSpec of the owner, like "=cat/pkg-1.0:0::installed"
+	 * @param package Package, as "cat/pkg"
+	 */
+	bool is_installed_version(const std::string & owner, const std::string & package)
+	{
+		if(package.empty())
+			return false;
+		std::string::size_type start = owner.compare(0, 1, "=") == 0 ? 1 : 0;
+		return owner.compare(start, package.size(), package) == 0
+			&& owner.size() > start + package.size() + 1
+			&& owner[start + package.size()] == '-'
+			&& std::isdigit(static_cast<unsigned char>(owner[start + package.size() + 1]));
+	}
+
+	/**
+	 * Find owners of colliding paths, through the daemon when it answers, the owner index otherwise
+	 * @param env Environment of the installed packages
+	 * @param root ${ROOT} the paths belong to
+	 * @param socketFile Socket of the daemon, empty to skip it
+	 * @param indexFile Owner index
+	 * @param paths Paths to look up
+	 * @param owners Owner of each path, empty when not owned
+	 */
+	void find_path_owners(const paludis::Environment * env, const std::string & root, const std::string & socketFile, const std::string & indexFile, const std::vector<std::string> & paths, std::vector<std::string> & owners)
+	{
+		if(!socketFile.empty() && OwnerClient(socketFile).query(root, installed_repositories(env), paths, owners))
+			return;
+		OwnerIndex index(indexFile);
+		index.load();
+		EnvironmentInstalledPackages installed(env);
+		if(index.refresh(installed))
+			index.save();
+		owners.clear();
+		for(std::vector<std::string>::const_iterator p(paths.begin()), p_end(paths.end()); p != p_end; ++p)
+		{
+			const std::string * owner(index.find(*p));
+			owners.push_back(owner ? *owner : std::string());
+		}
+	}
+
+	void usage()
+	{
+		std::cerr << "Usage: collision_preflight [--environment SPEC] [--root DIR] [--ignore DIRS] [--config-protect DIRS] [--config-protect-mask DIRS] [--archive-prefix DIR] [--index FILE] [--socket FILE] [CATEGORY/PN=]CANDIDATE..." << std::endl;
+		std::cerr << "A candidate is an ${IMAGE} directory or a binary package archive. When its package is given," << std::endl;
+		std::cerr << "files owned by installed versions of that package are not reported." << std::endl;
+		std::exit(2);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	std::string environment;
+	std::string root("/");
+	std::string ignore(paludis::getenv_with_default("COLLISION_IGNORE", ""));
+	std::string configProtect(paludis::getenv_with_default("CONFIG_PROTECT", ""));
+	std::string configProtectMask(paludis::getenv_with_default("CONFIG_PROTECT_MASK", ""));
+	std::string prefix;
+	std::string indexFile(owner_index_file());
+	std::string socketFile(owner_socket_file());
+	std::vector<Candidate> candidates;
+	for(int a(1); a < argc; ++a)
+	{
+		std::string arg(argv[a]);
+		if(arg.compare(0, 2, "--") != 0)
+		{
+			Candidate candidate;
+			std::string::size_type equal = arg.find('=');
+			if(equal != std::string::npos && arg[0] != '/' && arg[0] != '.' && arg.find('/') < equal)
+			{
+				candidate.package = arg.substr(0, equal);
+				arg.erase(0, equal + 1);
+			}
+			candidate.location = arg;
+			candidates.push_back(candidate);
+		}
+		else if(a + 1 == argc)
+			usage();
+		else if(arg == "--environment")
+			environment = argv[++a];
+		else if(arg == "--root")
+			root = argv[++a];
+		else if(arg == "--ignore")
+			ignore = argv[++a];
+		else if(arg == "--config-protect")
+			configProtect = argv[++a];
+		else if(arg == "--config-protect-mask")
+			configProtectMask = argv[++a];
+		else if(arg == "--archive-prefix")
+		{
+			prefix = argv[++a];
+			while(prefix.compare(0, 2, "./") == 0)
+				prefix.erase(0, 2);
+			if(!prefix.empty() && prefix[prefix.size() - 1] != '/')
+				prefix += "/";
+		}
+		else if(arg == "--index")
+			indexFile = argv[++a];
+		else if(arg == "--socket")
+			socketFile = argv[++a];
+		else
+			usage();
+	}
+	if(candidates.empty() || indexFile.empty())
+		usage();
+	canonicalize_path_in_place(root);
+	std::string rootPrefix(root == "/" ? "" : root);
+
+	std::vector<std::string> collIgnoreVector;
+	fill_collision_ignore(&collIgnoreVector, ignore, configProtectMask, configProtect, findGccDataInfoDir());
+	CollisionIgnore collIgnore(collIgnoreVector);
+
+/*
+ * Archives are listed in parallel, each by its own tar. Directories are walked entirely,
+ * to catch collisions between candidates, one after the other as the walk is parallel already.
+ */
+	std::vector<std::size_t> archives, directories;
+	for(std::size_t n(0), n_end(candidates.size()); n != n_end; ++n)
+	{
+		struct stat st;
+		if(::stat(candidates[n].location.c_str(), &st) != 0)
+			candidates[n].error = "not found";
+		else if(S_ISDIR(st.st_mode))
+			directories.push_back(n);
+		else
+			archives.push_back(n);
+	}
+	WorkStealingPool pool;
+	pool.run(archives.size(), [&candidates, &archives, &collIgnore, &rootPrefix, &prefix] (unsigned int, std::size_t n)
+	{
+		list_archive(candidates[archives[n]], prefix, collIgnore, rootPrefix);
+	});
+	for(std::vector<std::size_t>::const_iterator d(directories.begin()), d_end(directories.end()); d != d_end; ++d)
+	{
+		Candidate & candidate(candidates[*d]);
+		try
+		{
+			iterate_over_directory(paludis::FSPath(candidate.location), &candidate.files, collIgnore, root, true);
+		}
+		catch (paludis::FSError & error)
+		{
+			candidate.error = error.message();
+		}
+	}
+
+/*
+ * Look up owners of all files existing in ${ROOT} at once
+ */
+	std::unordered_map<std::string, std::size_t> slots;
+	std::vector<std::string> paths;
+	std::unordered_map<std::string, std::vector<std::size_t> > providers;
+	for(std::size_t n(0), n_end(candidates.size()); n != n_end; ++n)
+	{
+		const FSPathList & files(candidates[n].files);
+		for(FSPathList::const_iterator file(files.begin()), file_end(files.end()); file != file_end; ++file)
+		{
+			std::string path(files.pathString(*file));
+			if(file->collides && slots.insert(std::make_pair(path, paths.size())).second)
+				paths.push_back(path);
+			if(!collIgnore.matches(path))
+				providers[path].push_back(n);
+		}
+	}
+	std::vector<std::string> owners;
+	if(!paths.empty())
+	{
+		std::shared_ptr<paludis::Environment> env(paludis::EnvironmentFactory::get_instance()->create(environment));
+		find_path_owners(env.get(), root, socketFile, indexFile, paths, owners);
+	}
+
+/*
+ * Consolidated report, one section per candidate with collisions
+ */
+	unsigned long colliding = 0;
+	for(std::size_t n(0), n_end(candidates.size()); n != n_end; ++n)
+	{
+		const Candidate & candidate(candidates[n]);
+		FilesByPackage installedCollisions, candidateCollisions;
+		const FSPathList & files(candidate.files);
+		for(FSPathList::const_iterator file(files.begin()), file_end(files.end()); file != file_end; ++file)
+		{
+			std::string path(files.pathString(*file));
+			if(file->collides)
+			{
+				const std::string & owner(owners[slots[path]]);
+				if(owner.empty())
+					installedCollisions[""].push_back(paludis::FSPath(path));
+				else if(!is_installed_version(owner, candidate.package))
+					installedCollisions[owner].push_back(paludis::FSPath(path));
+			}
+			std::unordered_map<std::string, std::vector<std::size_t> >::const_iterator provider(providers.find(path));
+			if(provider != providers.end())
+				for(std::vector<std::size_t>::const_iterator other(provider->second.begin()), other_end(provider->second.end()); other != other_end; ++other)
+					if(*other != n)
+						candidateCollisions[candidates[*other].location].push_back(paludis::FSPath(path));
+		}
+		if(candidate.error.empty() && installedCollisions.empty() && candidateCollisions.empty())
+			continue;
+		++colliding;
+		std::cout << candidate.location << (candidate.package.empty() ? "" : " (" + candidate.package + ")") << " :" << std::endl;
+		if(!candidate.error.empty())
+			std::cout << "	Error : " << candidate.error << std::endl;
+		std::vector<std::pair<std::string, FilesByPackage *> > sections;
+		sections.push_back(std::make_pair("Collides with installed", &installedCollisions));
+		sections.push_back(std::make_pair("Collides with candidate", &candidateCollisions));
+		for(std::vector<std::pair<std::string, FilesByPackage *> >::const_iterator s(sections.begin()), s_end(sections.end()); s != s_end; ++s)
+		{
+			std::vector<std::string> keys;
+			for(FilesByPackage::const_iterator c(s->second->begin()), c_end(s->second->end()); c != c_end; ++c)
+				keys.push_back(c->first);
+			std::sort(keys.begin(), keys.end());
+			for(std::vector<std::string>::const_iterator k(keys.begin()), k_end(keys.end()); k != k_end; ++k)
+			{
+				if(k->empty())
+					std::cout << "	Orphaned files :" << std::endl;
+				else
+					std::cout << "	" << s->first << " " << *k << " :" << std::endl;
+				const std::vector<paludis::FSPath> & collided((*s->second)[*k]);
+				for(std::vector<paludis::FSPath>::const_iterator fs(collided.begin()), fs_end(collided.end()); fs != fs_end; ++fs)
+					std::cout << "		" << *fs << std::endl;
+			}
+		}
+	}
+	std::cout << candidates.size() << " candidates checked, " << colliding << " with collisions" << std::endl;
+	return colliding == 0 ? 0 : 1;
+}